@@ -4,7 +4,14 @@
 layout (location = 0) in vec3 vertexPosition;
 layout (location = 1) in vec3 vertexColor;
 
-uniform mat4 MVP;
+// camera data, uploaded once per frame and shared with the other shaders
+layout (std140) uniform Frame {
+    mat4 VP;
+    vec4 eye;
+    float time;
+};
+
+uniform mat4 M;
 
 // output data : used by fragment shader
 out vec3 fragColor;
@@ -17,6 +24,6 @@ void main ()
     // to produce the color of each fragment
     fragColor = vertexColor;
 
-    // Output position of the vertex, in clip space : MVP * position
-    gl_Position = MVP * v;
+    // Output position of the vertex, in clip space : VP * M * position
+    gl_Position = VP * (M * v);
 }
@@ -2,6 +2,9 @@
 #include <cmath>
 #include <fstream>
 #include <vector>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
 #include<unistd.h>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -10,14 +13,37 @@
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-#include <FTGL/ftgl.h>
+
+#include "audio.h"
+#include "bloxorz.h"
+#include "glyphatlas.h"
+#include "inputqueue.h"
+#include "levelpack.h"
+#include "cli.h"
 
 using namespace std;
 
+/* How a vertex is laid out in its VBO: position then an RGBA color of
+   normalized bytes, interleaved so a vertex is fetched from one place */
+struct VertexFormat {
+	GLenum PositionType;	// GL_FLOAT or GL_HALF_FLOAT
+	GLsizei Stride;		// bytes per vertex
+	GLsizei ColorOffset;	// where the color starts within a vertex
+};
+
+const VertexFormat VERTEX_FLOAT = { GL_FLOAT, 16, 12 };		// 3 floats, 4 bytes
+const VertexFormat VERTEX_HALF = { GL_HALF_FLOAT, 12, 8 };	// 3 halves + pad, 4 bytes; fine for small models
+
+struct Mesh {
+	std::vector<GLfloat> Positions;	// kept to pack each material's VBO
+	int NumVertices;
+	VertexFormat Format;
+};
+
 struct VAO {
 	GLuint VertexArrayID;
 	GLuint VertexBuffer;
-	GLuint ColorBuffer;
+	VertexFormat Format;
 
 	GLenum PrimitiveMode;
 	GLenum FillMode;
@@ -32,11 +58,22 @@ struct GLMatrices {
 	GLuint MatrixID;
 } Matrices;
 
-struct FTGLFont {
-  FTFont* font;
-  GLuint fontMatrixID;
-  GLuint fontColorID;
-} GL3Font;
+/* HUD text: glyph quads from a distance field atlas, placed on the CPU
+   as each string is recorded and drawn with one upload and one draw per
+   camera */
+struct TextVertex {
+	GLfloat Position[3];
+	GLfloat UV[2];
+	GLubyte Color[4];
+};
+
+struct TextBatch {
+	GlyphAtlas Atlas;
+	GLuint Texture;
+	GLuint VertexArrayID;
+	GLuint VertexBuffer;
+	std::vector<TextVertex> Vertices[2];	// scene camera, fixed camera
+} textBatch;
 
 GLuint programID, fontProgramID, textureProgramID;
 
@@ -130,95 +167,478 @@ void quit(GLFWwindow *window)
 }
 
 
-/* Generate VAO, VBOs and return VAO handle */
-struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL)
+/* Round a float to the nearest IEEE half; tiny values flush to zero */
+static GLushort toHalf (float f)
+{
+	GLuint bits;
+	memcpy(&bits, &f, sizeof bits);
+	GLuint sign = (bits >> 16) & 0x8000;
+	int exp = (int)((bits >> 23) & 0xff) - 127 + 15;
+	GLuint mant = bits & 0x7fffff;
+	if (exp <= 0)
+		return sign;
+	if (exp >= 31)
+		return sign | 0x7c00;
+	return (sign | (exp << 10) | (mant >> 13)) + ((mant >> 12) & 1);
+}
+
+/* Describe a model once; any number of VAOs can draw it in their own colors */
+struct Mesh* createMesh (int numVertices, const GLfloat* vertex_buffer_data, const VertexFormat& format=VERTEX_FLOAT)
+{
+	struct Mesh* mesh = new struct Mesh;
+	mesh->Positions.assign(vertex_buffer_data, vertex_buffer_data + 3*numVertices);
+	mesh->NumVertices = numVertices;
+	mesh->Format = format;
+	return mesh;
+}
+
+/* Pack positions and colors in the mesh's format into a new VBO; colors
+   may be NULL when only the positions are read */
+GLuint uploadVertices (const struct Mesh* mesh, const GLfloat* color_buffer_data)
+{
+	const VertexFormat& format = mesh->Format;
+	std::vector<GLubyte> packed(mesh->NumVertices*format.Stride, 0);
+	for (int i=0; i<mesh->NumVertices; i++) {
+		GLubyte* vertex = &packed[i*format.Stride];
+		const GLfloat* position = &mesh->Positions[3*i];
+		if (format.PositionType == GL_HALF_FLOAT) {
+			GLushort half[3] = { toHalf(position[0]), toHalf(position[1]), toHalf(position[2]) };
+			memcpy(vertex, half, sizeof half);
+		}
+		else
+			memcpy(vertex, position, 3*sizeof(GLfloat));
+		GLubyte* color = vertex + format.ColorOffset;
+		for (int k=0; k<3; k++)
+			color[k] = color_buffer_data ? (GLubyte)(max(0.0f, min(1.0f, color_buffer_data[3*i + k]))*255 + 0.5f) : 255;
+		color[3] = 255;
+	}
+
+	GLuint buffer;
+	glGenBuffers (1, &buffer);
+	glBindBuffer (GL_ARRAY_BUFFER, buffer);
+	glBufferData (GL_ARRAY_BUFFER, packed.size(), &packed[0], GL_STATIC_DRAW);
+	return buffer;
+}
+
+/* Generate a VAO drawing a mesh with its own per-vertex colors */
+struct VAO* create3DObject (GLenum primitive_mode, struct Mesh* mesh, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL)
 {
 	struct VAO* vao = new struct VAO;
 	vao->PrimitiveMode = primitive_mode;
-	vao->NumVertices = numVertices;
+	vao->NumVertices = mesh->NumVertices;
 	vao->FillMode = fill_mode;
+	vao->Format = mesh->Format;
 
 	// Create Vertex Array Object
 	// Should be done after CreateWindow and before any other GL calls
 	glGenVertexArrays(1, &(vao->VertexArrayID)); // VAO
-	glGenBuffers (1, &(vao->VertexBuffer)); // VBO - vertices
-	glGenBuffers (1, &(vao->ColorBuffer));  // VBO - colors
-
 	glBindVertexArray (vao->VertexArrayID); // Bind the VAO 
-	glBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices 
-	glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
+	vao->VertexBuffer = uploadVertices(mesh, color_buffer_data); // one interleaved VBO, left bound
 	glVertexAttribPointer(
 			0,                  // attribute 0. Vertices
 			3,                  // size (x,y,z)
-			GL_FLOAT,           // type
+			vao->Format.PositionType, // type
 			GL_FALSE,           // normalized?
-			0,                  // stride
+			vao->Format.Stride, // stride
 			(void*)0            // array buffer offset
 			);
-
-	glBindBuffer (GL_ARRAY_BUFFER, vao->ColorBuffer); // Bind the VBO colors 
-	glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), color_buffer_data, GL_STATIC_DRAW);  // Copy the vertex colors
 	glVertexAttribPointer(
 			1,                  // attribute 1. Color
 			3,                  // size (r,g,b)
-			GL_FLOAT,           // type
-			GL_FALSE,           // normalized?
-			0,                  // stride
-			(void*)0            // array buffer offset
+			GL_UNSIGNED_BYTE,   // type
+			GL_TRUE,            // normalized?
+			vao->Format.Stride, // stride
+			(void*)(intptr_t)vao->Format.ColorOffset // array buffer offset
 			);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
 
 	return vao;
 }
 
+/* Generate VAO, VBOs and return VAO handle, for geometry nothing else draws */
+struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL)
+{
+	Mesh mesh;
+	mesh.Positions.assign(vertex_buffer_data, vertex_buffer_data + 3*numVertices);
+	mesh.NumVertices = numVertices;
+	mesh.Format = VERTEX_FLOAT;
+	return create3DObject(primitive_mode, &mesh, color_buffer_data, fill_mode);
+}
+
 /* Generate VAO, VBOs and return VAO handle - Common Color for all vertices */
 struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat red, const GLfloat green, const GLfloat blue, GLenum fill_mode=GL_FILL)
 {
-	GLfloat* color_buffer_data = new GLfloat [3*numVertices];
+	std::vector<GLfloat> color_buffer_data(3*numVertices);
 	for (int i=0; i<numVertices; i++) {
 		color_buffer_data [3*i] = red;
 		color_buffer_data [3*i + 1] = green;
 		color_buffer_data [3*i + 2] = blue;
 	}
 
-	return create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
+	return create3DObject(primitive_mode, numVertices, vertex_buffer_data, &color_buffer_data[0], fill_mode);
+}
+
+/* The GL state draws depend on, as last set through the helpers below,
+   so that setting it again to the same value costs nothing. Anything
+   that changes it behind their back must call invalidateState(). */
+struct RenderState {
+	GLuint Program;
+	GLuint VertexArray;
+	GLuint ArrayBuffer;
+	GLenum FillMode;
+	GLuint FrameRange;	// which copy of the Frame block is bound
+	bool Known;		// false after invalidateState(): everything is resent
+	long Issued;		// state changes sent to GL since the last report
+	long Skipped;		// redundant ones that were not
+} renderState;
+
+void invalidateState ()
+{
+	renderState.Known = false;
+}
+
+/* Records value as current, and says whether GL needs to be told */
+static bool stateChanged (GLuint& current, GLuint value)
+{
+	if (!renderState.Known) {
+		renderState.Program = renderState.VertexArray = renderState.ArrayBuffer = renderState.FrameRange = ~0u;
+		renderState.FillMode = GL_NONE;
+		renderState.Known = true;
+	}
+	if (current == value) {
+		renderState.Skipped++;
+		return false;
+	}
+	current = value;
+	renderState.Issued++;
+	return true;
+}
+
+void useProgram (GLuint program)
+{
+	if (stateChanged(renderState.Program, program))
+		glUseProgram(program);
+}
+
+void bindVertexArray (GLuint vertexArray)
+{
+	if (stateChanged(renderState.VertexArray, vertexArray))
+		glBindVertexArray(vertexArray);
+}
+
+void bindArrayBuffer (GLuint buffer)
+{
+	if (stateChanged(renderState.ArrayBuffer, buffer))
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+}
+
+void polygonMode (GLenum fillMode)
+{
+	if (stateChanged(renderState.FillMode, fillMode))
+		glPolygonMode(GL_FRONT_AND_BACK, fillMode);
+}
+
+/* Camera data every shader reads from its Frame uniform block (std140).
+   It is uploaded once per frame in two copies, one seen from the scene
+   camera and one from the fixed camera menus and text use, so a draw
+   only sends its model matrix and switching cameras is a range bind. */
+#define FRAME_BINDING 0
+
+struct FrameUniforms {
+	glm::mat4 VP;
+	glm::vec4 Eye;		// camera position, w unused
+	GLfloat Time;		// seconds since glfwInit
+	GLfloat Pad[3];
+};
+
+struct FrameBlock {
+	GLuint Buffer;
+	GLint Stride;		// bytes between the copies, rounded up to the UBO alignment
+	bool Hud;		// draws through Matrices.view use the fixed camera
+	glm::mat4 SceneVP;	// kept on the CPU for culling
+	float Time;		// as uploaded this frame
+} frame;
+
+void createFrameBlock ()
+{
+	GLint alignment;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	frame.Stride = (sizeof(FrameUniforms) + alignment - 1) / alignment * alignment;
+	glGenBuffers(1, &frame.Buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, frame.Buffer);
+	glBufferData(GL_UNIFORM_BUFFER, 2*frame.Stride, NULL, GL_DYNAMIC_DRAW);
+}
+
+/* Point the program's Frame block at FRAME_BINDING */
+void bindFrameBlock (GLuint program)
+{
+	GLuint index = glGetUniformBlockIndex(program, "Frame");
+	if (index != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, index, FRAME_BINDING);
+}
+
+static void setFrameUniforms (FrameUniforms& u, const glm::mat4& view, float time)
+{
+	memset(&u, 0, sizeof u);
+	u.VP = Matrices.projection * view;
+	u.Eye = glm::inverse(view)[3];
+	u.Time = time;
+}
+
+/* The fixed camera for 2D (ortho) in the XY plane */
+const glm::mat4 hudView = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0));
+
+/* Upload both copies for this frame; draws start on the scene camera */
+void uploadFrame (const glm::mat4& sceneView)
+{
+	// one copy at a time, so nothing is allocated for the alignment gap
+	FrameUniforms u;
+	float time = glfwGetTime();
+	glBindBuffer(GL_UNIFORM_BUFFER, frame.Buffer);
+	setFrameUniforms(u, sceneView, time);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof u, &u);
+	setFrameUniforms(u, hudView, time);
+	glBufferSubData(GL_UNIFORM_BUFFER, frame.Stride, sizeof u, &u);
+	frame.Hud = false;
+	frame.SceneVP = Matrices.projection * sceneView;
+	frame.Time = time;
+}
+
+/* From here on this frame, Matrices.view is the fixed camera */
+void useHudCamera ()
+{
+	Matrices.view = hudView;
+	frame.Hud = true;
+}
+
+void bindCamera (bool hud)
+{
+	if (stateChanged(renderState.FrameRange, hud))
+		glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_BINDING, frame.Buffer, hud ? frame.Stride : 0, sizeof(FrameUniforms));
+}
+
+/* Send Matrices.model for the next draw, seen from the given camera */
+void setModel (GLuint modelID, bool hud)
+{
+	bindCamera(hud);
+	glUniformMatrix4fv(modelID, 1, GL_FALSE, &Matrices.model[0][0]);
 }
 
 /* Render the VBOs handled by VAO */
 void draw3DObject (struct VAO* vao)
 {
 	// Change the Fill Mode for this object
-	glPolygonMode (GL_FRONT_AND_BACK, vao->FillMode);
+	polygonMode (vao->FillMode);
 
-	// Bind the VAO to use
-	glBindVertexArray (vao->VertexArrayID);
-
-	// Enable Vertex Attribute 0 - 3d Vertices
-	glEnableVertexAttribArray(0);
-	// Bind the VBO to use
-	glBindBuffer(GL_ARRAY_BUFFER, vao->VertexBuffer);
-
-	// Enable Vertex Attribute 1 - Color
-	glEnableVertexAttribArray(1);
-	// Bind the VBO to use
-	glBindBuffer(GL_ARRAY_BUFFER, vao->ColorBuffer);
+	// Bind the VAO to use; it remembers the interleaved VBO and both attributes
+	bindVertexArray (vao->VertexArrayID);
 
 	// Draw the geometry !
 	glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
 }
 
+/* Per-frame counters, printed with the state cache numbers */
+struct FrameStats {
+	int Draws;		// draw list commands submitted
+	int Chunks;		// board chunks tested against the camera
+	int ChunksCulled;
+	int Tiles;		// tile instances drawn
+	int TilesCulled;	// skipped with their chunk
+	int TilesOccluded;	// hidden under the block in the top view
+	int ChunksBaked;	// board chunks whose instances were rebuilt
+} frameStats, lastFrameStats;
+
+/* Planes of a view volume, facing inwards, as ax+by+cz+d >= 0 */
+struct Frustum {
+	glm::vec4 Planes[6];
+};
+
+void extractFrustum (const glm::mat4& VP, Frustum& f)
+{
+	for (int i=0; i<3; i++) {
+		for (int k=0; k<4; k++) {
+			f.Planes[2*i][k] = VP[k][3] + VP[k][i];
+			f.Planes[2*i+1][k] = VP[k][3] - VP[k][i];
+		}
+	}
+}
+
+/* False only if the box is wholly outside one of the planes */
+bool boxVisible (const Frustum& f, const glm::vec3& lo, const glm::vec3& hi)
+{
+	for (int i=0; i<6; i++) {
+		const glm::vec4& p = f.Planes[i];
+		// the corner furthest along the plane normal
+		float x = p[0] > 0 ? hi[0] : lo[0];
+		float y = p[1] > 0 ? hi[1] : lo[1];
+		float z = p[2] > 0 ? hi[2] : lo[2];
+		if (p[0]*x + p[1]*y + p[2]*z + p[3] < 0)
+			return false;
+	}
+	return true;
+}
+
+/* draw() only records what it wants drawn; submitDrawList() then sorts
+   the list so draws sharing a program, VAO and fill mode run back to
+   back, and issues it. Recording touches no GL state. Coplanar draws
+   rely on GL_LEQUAL letting the later one win, so a layer ahead of the
+   state in the key keeps overlays after what they cover, and recording
+   order breaks the remaining ties. */
+enum { LAYER_WORLD, LAYER_OVERLAY, LAYER_TEXT };
+enum { DRAW_OBJECT, DRAW_CHUNK, DRAW_TEXT };
+
+struct DrawCommand {
+	uint64_t Key;		// layer, program, VAO, fill mode, recording order
+	int Kind;
+	VAO* Object;
+	bool Hud;		// seen from the fixed 2D camera
+	glm::mat4 Model;
+	int Chunk;		// board chunk only: which one
+	int Skip[2];		// board chunk only: instances left out, or -1
+};
+
+struct DrawList {
+	std::vector<DrawCommand> Commands;	// kept between frames so recording does not allocate
+} drawList;
+
+static bool keyLess (const DrawCommand& a, const DrawCommand& b)
+{
+	return a.Key < b.Key;
+}
+
+static DrawCommand& record (int kind, int layer, GLuint program, GLuint vertexArray, GLenum fillMode, bool hud)
+{
+	DrawCommand c;
+	c.Key = (uint64_t)layer << 62 | (uint64_t)(program & 0x3fff) << 48 | (uint64_t)(vertexArray & 0xffff) << 32 |
+		(uint64_t)(fillMode == GL_LINE) << 31 | drawList.Commands.size();
+	c.Kind = kind;
+	c.Object = NULL;
+	c.Hud = hud;
+	c.Model = Matrices.model;
+	drawList.Commands.push_back(c);
+	return drawList.Commands.back();
+}
+
+/* Draw vao with Matrices.model, from the scene or the fixed camera */
+void drawObject (VAO* vao, bool hud, int layer=LAYER_WORLD)
+{
+	record(DRAW_OBJECT, layer, programID, vao->VertexArrayID, vao->FillMode, hud).Object = vao;
+}
+
+/* Draw text with Matrices.model, after all the geometry. The glyphs
+   join the camera's text batch, which is drawn once */
+void drawText (const char* text, const glm::vec3& color, bool hud)
+{
+	std::vector<TextVertex>& batch = textBatch.Vertices[hud];
+	size_t before = batch.size();
+	GLubyte rgba[4] = { 0, 0, 0, 255 };
+	for (int k=0; k<3; k++)
+		rgba[k] = (GLubyte)(max(0.0f, min(1.0f, color[k]))*255 + 0.5f);
+	float pen = 0;
+	for (const char* p = text; *p; p++) {
+		const Glyph* g = textBatch.Atlas.find(*p);
+		if (!g)
+			continue;
+		if (g->x1 > g->x0) {
+			// two triangles, corners as (x, y, u, v)
+			const float corners[6][4] = {
+				{ g->x0, g->y0, g->u0, g->v0 }, { g->x1, g->y0, g->u1, g->v0 }, { g->x1, g->y1, g->u1, g->v1 },
+				{ g->x0, g->y0, g->u0, g->v0 }, { g->x1, g->y1, g->u1, g->v1 }, { g->x0, g->y1, g->u0, g->v1 },
+			};
+			for (int i=0; i<6; i++) {
+				glm::vec4 at = Matrices.model * glm::vec4(pen + corners[i][0], corners[i][1], 0, 1);
+				TextVertex v = { { at[0], at[1], at[2] }, { corners[i][2], corners[i][3] }, { rgba[0], rgba[1], rgba[2], rgba[3] } };
+				batch.push_back(v);
+			}
+		}
+		pen += g->advance;
+	}
+	// the first glyphs of the frame queue the batch's one draw
+	if (before == 0 && !batch.empty())
+		record(DRAW_TEXT, LAYER_TEXT, fontProgramID, textBatch.VertexArrayID, GL_FILL, hud);
+}
+
+/* Upload a camera's text batch over the last one and draw it, blended
+   so the glyph edges stay smooth */
+void submitText (bool hud)
+{
+	std::vector<TextVertex>& batch = textBatch.Vertices[hud];
+	if (batch.empty())
+		return;
+	useProgram(fontProgramID);
+	bindCamera(hud);
+	bindVertexArray(textBatch.VertexArrayID);
+	polygonMode(GL_FILL);
+	bindArrayBuffer(textBatch.VertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, batch.size()*sizeof(TextVertex), &batch[0], GL_STREAM_DRAW);
+	glBindTexture(GL_TEXTURE_2D, textBatch.Texture);
+	glEnable(GL_BLEND);
+	glDrawArrays(GL_TRIANGLES, 0, batch.size());
+	glDisable(GL_BLEND);
+	batch.clear();
+}
+
+void submitChunk (int k, const int* skip);
+
+void submitDrawList ()
+{
+	std::sort(drawList.Commands.begin(), drawList.Commands.end(), keyLess);
+	frameStats.Draws = drawList.Commands.size();
+	for (size_t i = 0; i < drawList.Commands.size(); i++) {
+		const DrawCommand& c = drawList.Commands[i];
+		Matrices.model = c.Model;
+		switch (c.Kind) {
+		case DRAW_OBJECT:
+			useProgram(programID);
+			setModel(Matrices.MatrixID, c.Hud);
+			draw3DObject(c.Object);
+			break;
+		case DRAW_CHUNK:
+			submitChunk(c.Chunk, c.Skip);
+			break;
+		case DRAW_TEXT:
+			submitText(c.Hud);
+			break;
+		}
+	}
+	drawList.Commands.clear();
+	lastFrameStats = frameStats;
+	memset(&frameStats, 0, sizeof frameStats);
+}
+
 /**************************
  * Customizable functions *
  **************************/
-int l6=0,r6=0,l7=0,r7=0,r8=0,r9=0;
-
 float triangle_rot_dir = 1;
 float rectangle_rot_dir = 1;
 bool triangle_rot_status = true;
 bool rectangle_rot_status = true;
-int posx1=0,posy1=0,posx2=0,posy2=6,flag=1,posz1=0,posz2=0;
+int flag=1;
+
+/* The game advances in fixed ticks whatever the frame rate, and draw()
+   blends the block heights of the last two ticks by tickAlpha */
+#define TICK_RATE 120
+#define TICK (1.0/TICK_RATE)
+#define DROP_IN_SPEED 120.0f	// block dropping onto a new level, units per second
+#define SINK_SPEED 40.0f	// block sinking off the board or into the goal
+float spo;			// drop-in height left
+float posy1=0,posy2=6;		// height of each half of the block
+float lastSpo, lastPosy1, lastPosy2;	// the same, one tick earlier
+float tickAlpha;		// how far the frame is between the last tick and the next
+double gameTime=0;		// seconds of ticks run so far; the game's only clock
+int swapInterval=1;		// 0 with --uncapped
+bool showStats=false;		// --stats prints the counters every half second
+
+/* Jumps rather than blends to the block's current heights */
+void snapBlock ()
+{
+	lastSpo=spo;
+	lastPosy1=posy1;
+	lastPosy2=posy2;
+}
+bool occlusionCulling=true;	// skip tiles hidden under the block in the top view
 int triangle_rotation;
-int disable=0;
-int l8f=0;
 int moves=0;
 int stmove=0;
 int ent=0;
@@ -230,11 +650,40 @@ int pass=0;
 int view=0;
 int menu=0;
 int soff=0;
-int l3=0,r3=0;
-int r4=0;
-/* Executed when a regular key is pressed/released/held-down */
-/* Prefered for Keyboard events */
-void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
+LevelPackFile stagePack;		// DEFAULT_BINARY_PACK, stage n is record n-1
+int lastStage;			// flag past this shows the end screen
+Level board;
+BlockState block;
+
+/* Rolls the block one step; shared by the arrow keys and the on-screen arrows */
+void playMove (int move)
+{
+	if(block.status!=STATUS_PLAYING)
+		return;
+	if(soff==0)
+		playSound(SOUND_MOVE);
+	moves++;
+	stmove++;
+	int events=step(board,block,move);
+	if((events & EVENT_SWITCH) && soff==0)
+		playSound(SOUND_SWITCH);
+	posy1=0;
+	posy2=(block.orient==ORIENT_STANDING)?6:0;
+	snapBlock();
+}
+
+
+/* GLFW's callbacks only queue what happened; processInput() applies it
+   once a frame, in arrival order */
+InputQueue inputQueue;
+
+struct InputStats {
+	int Events;		// applied since the last report
+	double MaxLatency;	// seconds from callback to applying
+} inputStats;
+
+/* Applies a key press/release/repeat */
+void handleKey (GLFWwindow* window, int key, int action)
 {
 	// Function is called first on GLFW_PRESS.
 
@@ -302,180 +751,15 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
 	if(key==GLFW_KEY_H)
 		view=4;
 
-	if(key==GLFW_KEY_RIGHT && action==GLFW_PRESS && !disable){
-		if(soff==0)
-
-		system("mpg123  -vC sound1.mp3 &");
-		moves++;
-		stmove++;
-		if(l8f==0){
-
-		if(posx1==posx2 && posy2>posy1){
-			posx1+=6;
-			posx2+=12;
-			posy2-=6;
-
-		}
-
-		else if(posx1==posx2 && posy1>posy2){
-			posx1+=12;
-			posx2+=6;
-			posy1-=6;
-		}
-		else if(posx1>posx2 && posy1==posy2){
-			posx1+=6;
-			posx2+=12;
-			posy2+=6;
-		}
-		else if(posx2>posx1 && posy1==posy2){
-			posx2+=6;
-			posx1+=12;
-			posy1+=6;
-		}
-		else if(posx2==posx1 && posy1==posy2){
-			posx1+=6;
-			posx2+=6;
-			//posz2+=6;
-		}
-	}
-	else if(l8f==1){
-		posx2+=6;
-	}
-	else if(l8f==2){
-		posx1+=6;
-	}
-
-	}
-
-	else if(key==GLFW_KEY_LEFT && action==GLFW_PRESS && !disable){
-		moves++;
-		stmove++;
-		if(soff==0)
-
-		system("mpg123  -vC sound1.mp3 &");
-
-		if(l8f==0){
-
-		if(posx1==posx2 && posy2>posy1){
-			posx1-=6;
-			posx2-=12;
-			posy2-=6;
-
-		}
-
-		else if(posx1==posx2 && posy1>posy2){
-			posx1-=12;
-			posx2-=6;
-			posy1-=6;
-		}
-		else if(posx1>posx2 && posy1==posy2){
-			posx1-=12;
-			posx2-=6;
-			posy1+=6;
-		}
-		else if(posx2>posx1 && posy1==posy2){
-			posx1-=6;
-			posx2-=12;
-			posy2+=6;
-		}
-		else if(posx2==posx1 && posy1==posy2){
-			posx1-=6;
-			posx2-=6;
-			//posz2+=6;
-		}
-	}
-	else if(l8f==1){
-		posx2-=6;
-	}
-	else if(l8f==2)
-		posx1-=6;
-	}
-
-	else if(key==GLFW_KEY_UP && action==GLFW_PRESS && !disable){
-		moves++;
-		stmove++;
-		if(soff==0)
-
-		system("mpg123  -vC sound1.mp3 &");
-
-		if(l8f==0)
-		{
-		if(posz1==posz2 && posy2>posy1){
-			posz1-=6;
-			posz2-=12;
-			posy2-=6;
-
-		}
-
-		else if(posz1==posz2 && posy1>posy2){
-			posz1-=12;
-			posz2-=6;
-			posy1-=6;
-		}
-		else if(posz1>posz2 && posy1==posy2){
-			posz1-=12;
-			posz2-=6;
-			posy1+=6;
-		}
-		else if(posz2>posz1 && posy1==posy2){
-			posz1-=6;
-			posz2-=12;
-			posy2+=6;
-		}
-		else if(posz2==posz1 && posy1==posy2){
-			posz1-=6;
-			posz2-=6;
-			//posz2+=6;
-		}
-			}
-			else if(l8f==1){
-				posz2-=6;
-			}
-			else if(l8f==2)
-				posz1-=6;
-
-	}
-	if(key==GLFW_KEY_DOWN && action==GLFW_PRESS && !disable){
-		moves++;
-		stmove++;
-		if(soff==0)
-
-		system("mpg123  -vC sound1.mp3 &");
-
-		if(l8f==0){
-		if(posz1==posz2 && posy2>posy1){
-			posz1+=6;
-			posz2+=12;
-			posy2-=6;
-
-		}
-
-		else if(posz1==posz2 && posy1>posy2){
-			posz1+=12;
-			posz2+=6;
-			posy1-=6;
-		}
-		else if(posz1>posz2 && posy1==posy2){
-			posz1+=6;
-			posz2+=12;
-			posy2+=6;
-		}
-		else if(posz2>posz1 && posy1==posy2){
-			posz2+=6;
-			posz1+=12;
-			posy1+=6;
-		}
-		else if(posz2==posz1 && posy1==posy2){
-			posz1+=6;
-			posz2+=6;
-			//posz2+=6;
-		}
-	}
-	else if(l8f==1)
-		posz2+=6;
-	else if(l8f==2)
-		posz1+=6;
-
+	if(action==GLFW_PRESS){
+		if(key==GLFW_KEY_RIGHT)
+			playMove(MOVE_RIGHT);
+		else if(key==GLFW_KEY_LEFT)
+			playMove(MOVE_LEFT);
+		else if(key==GLFW_KEY_UP)
+			playMove(MOVE_UP);
+		else if(key==GLFW_KEY_DOWN)
+			playMove(MOVE_DOWN);
 	}
 }
 
@@ -496,8 +780,8 @@ int mouse=0;
 int togtext=0;
 double lxg;
 		double lyg;
-/* Executed when a mouse button is pressed/released */
-void mouseButton (GLFWwindow* window, int button, int action, int mods)
+/* Applies a mouse button press/release at cursor position (lx, ly) */
+void handleMouseButton (GLFWwindow* window, int button, int action, double lx, double ly)
 {
 	switch (button) {
 		case GLFW_MOUSE_BUTTON_LEFT:
@@ -530,13 +814,11 @@ void mouseButton (GLFWwindow* window, int button, int action, int mods)
 			lmouse=0;
 	}
 	if(lmouse1==1){
-		glfwGetCursorPos(window, &lxg, &lyg);
+		lxg=lx;
+		lyg=ly;
 
 	}
 	if(lmouse==1){
-		double lx;
-		double ly;
-		glfwGetCursorPos(window, &lx, &ly);
 		if(lx>593 && lx<860 && ly>434 && ly<490){
 			enter=1;
 
@@ -553,9 +835,6 @@ void mouseButton (GLFWwindow* window, int button, int action, int mods)
 		
 	}
 	if(mouse==1){
-		double lx;
-		double ly;
-		glfwGetCursorPos(window, &lx, &ly);
 		if(lx>84 && lx<171 && ly>21 && ly<65){
 			if(menu==0)
 			menu=1;
@@ -569,190 +848,53 @@ void mouseButton (GLFWwindow* window, int button, int action, int mods)
 			soff=0;
 		}
 		if(lx>160 && lx<220 && ly>316 && ly<340 && menu==1){
-			flag=9;
+			flag=lastStage+1;
 		}
-		//-18.0f+posx1+l3+l6+l7, 3.0f+posy1+spo, -6.0f+posz1+r3+r4+r6+r7+r8+r9)); // glTra
-		if(lx>1371 && lx<1404 && ly>625 && ly<656){
-			if(soff==0)
-
-		system("mpg123  -vC sound1.mp3 &");
-		moves++;
-		stmove++;
-		if(l8f==0){
+		if(lx>1371 && lx<1404 && ly>625 && ly<656)
+			playMove(MOVE_RIGHT);
+		else if(lx>1225 && lx<1254 && ly>625 && ly<656)
+			playMove(MOVE_LEFT);
+		else if(lx>1300 && lx<1327 && ly>544 && ly<573)
+			playMove(MOVE_UP);
+		else if(lx>1300 && lx<1327 && ly>700 && ly<734)
+			playMove(MOVE_DOWN);
 
-		if(posx1==posx2 && posy2>posy1){
-			posx1+=6;
-			posx2+=12;
-			posy2-=6;
 
 		}
 
-		else if(posx1==posx2 && posy1>posy2){
-			posx1+=12;
-			posx2+=6;
-			posy1-=6;
-		}
-		else if(posx1>posx2 && posy1==posy2){
-			posx1+=6;
-			posx2+=12;
-			posy2+=6;
-		}
-		else if(posx2>posx1 && posy1==posy2){
-			posx2+=6;
-			posx1+=12;
-			posy1+=6;
-		}
-		else if(posx2==posx1 && posy1==posy2){
-			posx1+=6;
-			posx2+=6;
-			//posz2+=6;
-		}
-	}
-	else if(l8f==1){
-		posx2+=6;
 	}
-	else if(l8f==2){
-		posx1+=6;
-	}
-		}
 
-		else if(lx>1225 && lx<1254 && ly>625 && ly<656){
-			moves++;
-		stmove++;
-		if(soff==0)
-
-		system("mpg123  -vC sound1.mp3 &");
-
-		if(l8f==0){
-
-		if(posx1==posx2 && posy2>posy1){
-			posx1-=6;
-			posx2-=12;
-			posy2-=6;
-
-		}
-
-		else if(posx1==posx2 && posy1>posy2){
-			posx1-=12;
-			posx2-=6;
-			posy1-=6;
-		}
-		else if(posx1>posx2 && posy1==posy2){
-			posx1-=12;
-			posx2-=6;
-			posy1+=6;
-		}
-		else if(posx2>posx1 && posy1==posy2){
-			posx1-=6;
-			posx2-=12;
-			posy2+=6;
-		}
-		else if(posx2==posx1 && posy1==posy2){
-			posx1-=6;
-			posx2-=6;
-			//posz2+=6;
-		}
-	}
-	else if(l8f==1){
-		posx2-=6;
-	}
-	else if(l8f==2)
-		posx1-=6;
-	}
-
-
-else if(lx>1300 && lx<1327 && ly>544 && ly<573 ){
-	moves++;
-		stmove++;
-		if(soff==0)
-
-		system("mpg123  -vC sound1.mp3 &");
-
-		if(l8f==0)
-		{
-		if(posz1==posz2 && posy2>posy1){
-			posz1-=6;
-			posz2-=12;
-			posy2-=6;
-
-		}
-
-		else if(posz1==posz2 && posy1>posy2){
-			posz1-=12;
-			posz2-=6;
-			posy1-=6;
-		}
-		else if(posz1>posz2 && posy1==posy2){
-			posz1-=12;
-			posz2-=6;
-			posy1+=6;
-		}
-		else if(posz2>posz1 && posy1==posy2){
-			posz1-=6;
-			posz2-=12;
-			posy2+=6;
-		}
-		else if(posz2==posz1 && posy1==posy2){
-			posz1-=6;
-			posz2-=6;
-			//posz2+=6;
-		}
-			}
-			else if(l8f==1){
-				posz2-=6;
-			}
-			else if(l8f==2)
-				posz1-=6;
+/* Executed when a regular key is pressed/released/held-down */
+/* Prefered for Keyboard events */
+void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	InputEvent e = { glfwGetTime(), INPUT_KEY, key, action, 0, 0 };
+	inputQueue.push(e);
 }
 
-
-else if(lx>1300 && lx<1327 && ly>700 && ly<734){
-	moves++;
-		stmove++;
-		if(soff==0)
-
-		system("mpg123  -vC sound1.mp3 &");
-
-		if(l8f==0){
-		if(posz1==posz2 && posy2>posy1){
-			posz1+=6;
-			posz2+=12;
-			posy2-=6;
-
-		}
-
-		else if(posz1==posz2 && posy1>posy2){
-			posz1+=12;
-			posz2+=6;
-			posy1-=6;
-		}
-		else if(posz1>posz2 && posy1==posy2){
-			posz1+=6;
-			posz2+=12;
-			posy2+=6;
-		}
-		else if(posz2>posz1 && posy1==posy2){
-			posz2+=6;
-			posz1+=12;
-			posy1+=6;
-		}
-		else if(posz2==posz1 && posy1==posy2){
-			posz1+=6;
-			posz2+=6;
-			//posz2+=6;
-		}
-	}
-	else if(l8f==1)
-		posz2+=6;
-	else if(l8f==2)
-		posz1+=6;
-
+/* Executed when a mouse button is pressed/released */
+void mouseButton (GLFWwindow* window, int button, int action, int mods)
+{
+	// the buttons are hit-tested where the cursor was at the click
+	InputEvent e = { glfwGetTime(), INPUT_MOUSE_BUTTON, button, action, 0, 0 };
+	glfwGetCursorPos(window, &e.x, &e.y);
+	inputQueue.push(e);
 }
 
-
-		}
-
+/* Apply the queued input, oldest first */
+void processInput (GLFWwindow* window)
+{
+	InputEvent e;
+	double now = glfwGetTime();
+	while (inputQueue.pop(e)) {
+		inputStats.Events++;
+		inputStats.MaxLatency = max(inputStats.MaxLatency, now - e.time);
+		if (e.kind == INPUT_KEY)
+			handleKey(window, e.code, e.action);
+		else
+			handleMouseButton(window, e.code, e.action, e.x, e.y);
 	}
+}
 
 int dis=0;
 float zoom=1;
@@ -788,7 +930,10 @@ void reshapeWindow (GLFWwindow* window, int width, int height)
 
 }
 
-VAO *triangle,*triangle1,*triangle2,*triangle3, *rectangle,*cuboid[10][15],*cub1,*cub2,*circle,*rectangle1,*rectangle2,*rect[10][15],*level[7],*cuboid1[10][15],*dcub,*dcu,*circle1,*dcub1,*dcub2,*dcub3,*dcub4,*dcub5;
+VAO *triangle,*triangle1,*triangle2,*triangle3, *rectangle,*cub1,*cub2,*circle,*rectangle1,*rectangle2,*dcub,*circle1,*dcub1,*dcub2,*dcub3;
+
+/* Shared geometry: the VAOs above are materials drawing these */
+Mesh *triangleMesh, *rectangleMesh, *cubeMesh;
 
 // Creates the triangle object used in this sample code
 void createTriangle ()
@@ -809,12 +954,12 @@ void createTriangle ()
 	};
 
 	// create3DObject creates and returns a handle to a VAO that can be used later
-	triangle = create3DObject(GL_TRIANGLES, 3, vertex_buffer_data, color_buffer_data, GL_FILL);
-	triangle1 = create3DObject(GL_TRIANGLES, 3, vertex_buffer_data, color_buffer_data, GL_FILL);
-
-	triangle2 = create3DObject(GL_TRIANGLES, 3, vertex_buffer_data, color_buffer_data, GL_FILL);
-
-	triangle3 = create3DObject(GL_TRIANGLES, 3, vertex_buffer_data, color_buffer_data, GL_FILL);
+	triangleMesh = createMesh(3, vertex_buffer_data, VERTEX_HALF);
+	triangle = create3DObject(GL_TRIANGLES, triangleMesh, color_buffer_data, GL_FILL);
+	// the four arrow heads only differ by their model matrix
+	triangle1 = triangle;
+	triangle2 = triangle;
+	triangle3 = triangle;
 
 }
 
@@ -831,16 +976,6 @@ void createRectangle ()
 		-1.2, 1,0, // vertex 4
 		-1.2,-1,0  // vertex 1
 	};
-	GLfloat display [] = {
-		0,0,0, // vertex 1
-		12,0,0, // vertex 2
-		12, 2,0, // vertex 3
-
-		12, 2,0, // vertex 3
-		0, 2,0, // vertex 4
-		0,0,0 
-	};
-
 	 GLfloat color_buffer_data [] = {
 		0,0,0, // color 1
 		0,0,0, // color 2
@@ -870,28 +1005,269 @@ void createRectangle ()
 	};
 
 	// create3DObject creates and returns a handle to a VAO that can be used later
-	rectangle = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
-	rectangle1 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, colordisplay, GL_FILL);
-	rectangle2 = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, colordisplay1, GL_FILL);
+	rectangleMesh = createMesh(6, vertex_buffer_data, VERTEX_HALF);
+	rectangle = create3DObject(GL_TRIANGLES, rectangleMesh, color_buffer_data, GL_FILL);
+	rectangle1 = create3DObject(GL_TRIANGLES, rectangleMesh, colordisplay, GL_FILL);
+	rectangle2 = create3DObject(GL_TRIANGLES, rectangleMesh, colordisplay1, GL_FILL);
+}
+/* The board is drawn in CHUNK_SIZE x CHUNK_SIZE chunks of tile instances
+   over one shared cube. A chunk's instances are baked into its own
+   buffer when a level loads, and only baked again when a switch flips
+   one of its cells or a fragile tile in it breaks. Each instance is (x, z, palette, drop start) and a
+   drop speed; Tile_GL.vert works out how far the tile has risen from
+   those and the frame time, so the drop-in costs the CPU nothing. The
+   palettes hold the per-vertex colours of the even/odd floor and
+   fragile tiles; TILE_LIGHT always takes the even floor one. */
+#define TILE_PALETTES 4
+#define CHUNK_SIZE 16
+#define INSTANCE_FLOATS 5
+#define DROP_RATE 40.0f	// units per second per (row+column), 1/1.5 a frame at 60 Hz
+
+struct BoardChunk {
+	GLuint VertexArrayID;	// 0 until the chunk is first baked
+	GLuint InstanceBuffer;
+	int Capacity;		// instances InstanceBuffer has room for
+	int Count;
+	int X0, Z0, X1, Z1;	// cells covered, end exclusive
+	bool Dirty;		// instances no longer match the board
+	std::vector<int> Slots;	// instance index of each cell, -1 if none
+};
+
+struct BoardMesh {
+	GLuint VertexBuffer;	// cube positions
+	VertexFormat Format;
+	GLuint ProgramID;
+	int ChunkCols, ChunkRows;
+	std::vector<BoardChunk> Chunks;		// kept across levels to reuse their buffers
+	std::vector<std::vector<int> > SwitchChunks;	// chunks holding the targets of each switch
+	unsigned Switches;	// switch bits the chunks were baked with
+	int Broken;		// brokenCell() the chunks were baked with
+	float DropStart;	// frame time the tiles start rising, <0 until the board is first shown
+	std::vector<GLfloat> Scratch;
+} boardMesh;
+
+GLfloat tilePalette[TILE_PALETTES*36*3];
+
+/* Chunk holding a board cell */
+static int chunkOf (int cell)
+{
+	return cell / board.cols / CHUNK_SIZE * boardMesh.ChunkCols + cell % board.cols / CHUNK_SIZE;
+}
+
+void createBoardMesh (struct Mesh* cube)
+{
+	// colors come from the palette uniform, so only the positions are read
+	boardMesh.VertexBuffer = uploadVertices(cube, NULL);
+	boardMesh.Format = cube->Format;
+}
+
+/* Lay the chunks over the board just loaded; all of them need baking */
+void loadBoardMesh ()
+{
+	boardMesh.ChunkCols = (board.cols + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	boardMesh.ChunkRows = (board.rows + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	if ((int)boardMesh.Chunks.size() < boardMesh.ChunkCols*boardMesh.ChunkRows)
+		boardMesh.Chunks.resize(boardMesh.ChunkCols*boardMesh.ChunkRows, BoardChunk());
+	for (int k=0; k<boardMesh.ChunkCols*boardMesh.ChunkRows; k++) {
+		BoardChunk& c = boardMesh.Chunks[k];
+		c.X0 = k % boardMesh.ChunkCols * CHUNK_SIZE;
+		c.Z0 = k / boardMesh.ChunkCols * CHUNK_SIZE;
+		c.X1 = min(c.X0 + CHUNK_SIZE, board.cols);
+		c.Z1 = min(c.Z0 + CHUNK_SIZE, board.rows);
+		c.Dirty = true;
+	}
+	boardMesh.DropStart = -1;
+
+	boardMesh.SwitchChunks.assign(board.switches.size(), std::vector<int>());
+	for (size_t s=0; s<board.switches.size(); s++)
+		for (int cell=0; cell<board.rows*board.cols; cell++)
+			if (board.switches[s].targets.test(cell)) {
+				int k = chunkOf(cell);
+				std::vector<int>& chunks = boardMesh.SwitchChunks[s];
+				if (chunks.empty() || chunks.back() != k)
+					chunks.push_back(k);
+			}
+	boardMesh.Switches = block.switches;
+	boardMesh.Broken = brokenCell(board, block);
+}
+
+static void bakeChunk (BoardChunk& c)
+{
+	std::vector<GLfloat>& data = boardMesh.Scratch;
+	data.clear();
+	c.Slots.assign(CHUNK_SIZE*CHUNK_SIZE, -1);
+	for (int i=c.Z0; i<c.Z1; i++)
+		for (int j=c.X0; j<c.X1; j++) {
+			int t = tileAt(board, block, j, i);
+			if (t!=TILE_FLOOR && t!=TILE_LIGHT && t!=TILE_SOFT_SWITCH && t!=TILE_HEAVY_SWITCH && t!=TILE_FRAGILE)
+				continue;
+			c.Slots[(i-c.Z0)*CHUNK_SIZE + j-c.X0] = data.size()/INSTANCE_FLOATS;
+			// tiles further from the corner rise faster, so the board sweeps in
+			GLfloat instance[INSTANCE_FLOATS] = { (j+1)*6-30.0f, (i+1)*6-30.0f, (GLfloat)(t==TILE_LIGHT ? 0 : (t==TILE_FRAGILE?2:0)+(i+j)%2),
+				boardMesh.DropStart, (i+j)*DROP_RATE };
+			data.insert(data.end(), instance, instance+INSTANCE_FLOATS);
+		}
+	c.Count = data.size()/INSTANCE_FLOATS;
+	c.Dirty = false;
+	if (c.Count == 0)
+		return;
+
+	if (!c.VertexArrayID) {
+		glGenVertexArrays(1, &c.VertexArrayID);
+		glGenBuffers(1, &c.InstanceBuffer);
+		c.Capacity = 0;
+		bindVertexArray(c.VertexArrayID);
+		bindArrayBuffer(boardMesh.VertexBuffer);
+		glVertexAttribPointer(0, 3, boardMesh.Format.PositionType, GL_FALSE, boardMesh.Format.Stride, (void*)0);
+		glEnableVertexAttribArray(0);
+		bindArrayBuffer(c.InstanceBuffer);
+		glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, INSTANCE_FLOATS*sizeof(GLfloat), (void*)0);
+		glVertexAttribDivisor(2, 1);
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, INSTANCE_FLOATS*sizeof(GLfloat), (void*)(4*sizeof(GLfloat)));
+		glVertexAttribDivisor(3, 1);
+		glEnableVertexAttribArray(3);
+	}
+	bindArrayBuffer(c.InstanceBuffer);
+	if (c.Count > c.Capacity) {
+		c.Capacity = c.Count;
+		glBufferData(GL_ARRAY_BUFFER, data.size()*sizeof(GLfloat), &data[0], GL_STATIC_DRAW);
+	}
+	else
+		glBufferSubData(GL_ARRAY_BUFFER, 0, data.size()*sizeof(GLfloat), &data[0]);
+}
+
+/* Mark the chunks a switch or a broken tile changed and bake whatever
+   is out of date */
+void updateBoardMesh ()
+{
+	// the drop-in starts when the board is first shown, not when it is loaded
+	if (boardMesh.DropStart < 0)
+		boardMesh.DropStart = frame.Time;
+
+	unsigned flipped = block.switches ^ boardMesh.Switches;
+	for (size_t s=0; flipped && s<boardMesh.SwitchChunks.size(); s++)
+		if (flipped & (1u << s))
+			for (size_t n=0; n<boardMesh.SwitchChunks[s].size(); n++)
+				boardMesh.Chunks[boardMesh.SwitchChunks[s][n]].Dirty = true;
+	boardMesh.Switches = block.switches;
 
-	for(int i=0;i<10;i++){
-		for(int j=0;j<15;j++)
-	rect[i][j] = create3DObject(GL_TRIANGLES, 6, vertex_buffer_data, color_buffer_data, GL_FILL);
+	int broken = brokenCell(board, block);
+	if (broken != boardMesh.Broken) {
+		if (broken >= 0)
+			boardMesh.Chunks[chunkOf(broken)].Dirty = true;
+		if (boardMesh.Broken >= 0)
+			boardMesh.Chunks[chunkOf(boardMesh.Broken)].Dirty = true;
+		boardMesh.Broken = broken;
 	}
-	for(int i=0;i<7;i++)
-		level[i]=create3DObject(GL_TRIANGLES, 6, display, colordisplay, GL_FILL);
 
+	for (int k=0; k<boardMesh.ChunkCols*boardMesh.ChunkRows; k++) {
+		BoardChunk& c = boardMesh.Chunks[k];
+		if (c.Dirty) {
+			bakeChunk(c);
+			frameStats.ChunksBaked++;
+		}
+	}
+}
+
+/* Queue the chunks the scene camera can see; in the top view, leave out
+   the tiles the block covers */
+void drawBoard (bool occlusion)
+{
+	Frustum frustum;
+	extractFrustum(frame.SceneVP, frustum);
+	int bx[2],bz[2],bcells=0;
+	// from straight above the block covers exactly the tiles under it
+	if(occlusion && view==2 && block.status==STATUS_PLAYING)
+		bcells=blockCells(block,bx,bz);
+
+	for (int k=0; k<boardMesh.ChunkCols*boardMesh.ChunkRows; k++) {
+		BoardChunk& c = boardMesh.Chunks[k];
+		if (c.Count == 0)
+			continue;
+		// tiles are 6 wide and 0.8 high, anywhere from their drop-in height up to 0
+		glm::vec3 lo(c.X0*6-27.0f, -60.8f, c.Z0*6-27.0f), hi(c.X1*6-27.0f, 0.8f, c.Z1*6-27.0f);
+		frameStats.Chunks++;
+		if (!boxVisible(frustum, lo, hi)) {
+			frameStats.ChunksCulled++;
+			frameStats.TilesCulled += c.Count;
+			continue;
+		}
+		int skip[2] = { -1, -1 };
+		for (int n=0; n<bcells && n<2; n++)
+			if (bx[n]>=c.X0 && bx[n]<c.X1 && bz[n]>=c.Z0 && bz[n]<c.Z1)
+				skip[n] = c.Slots[(bz[n]-c.Z0)*CHUNK_SIZE + bx[n]-c.X0];
+		if (skip[0] > skip[1])
+			swap(skip[0], skip[1]);
+		if (skip[0] == skip[1])
+			skip[0] = -1;
+		int occluded = (skip[0] >= 0) + (skip[1] >= 0);
+		frameStats.TilesOccluded += occluded;
+		frameStats.Tiles += c.Count - occluded;
+		DrawCommand& d = record(DRAW_CHUNK, LAYER_WORLD, boardMesh.ProgramID, c.VertexArrayID, GL_FILL, false);
+		d.Chunk = k;
+		d.Skip[0] = skip[0];
+		d.Skip[1] = skip[1];
+	}
+}
+
+/* Draw the chunk's instances around the skipped ones, which are in
+   increasing order or -1 */
+void submitChunk (int k, const int* skip)
+{
+	BoardChunk& c = boardMesh.Chunks[k];
+	useProgram(boardMesh.ProgramID);
+	bindCamera(false);
+	polygonMode(GL_FILL);
+	bindVertexArray(c.VertexArrayID);
+	bindArrayBuffer(c.InstanceBuffer);
+	int from = 0;
+	for (int n=0; n<3; n++) {
+		int to = n < 2 ? skip[n] : c.Count;
+		if (to < 0)
+			continue;
+		if (to > from) {
+			glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, INSTANCE_FLOATS*sizeof(GLfloat), (void*)(from*INSTANCE_FLOATS*sizeof(GLfloat)));
+			glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, INSTANCE_FLOATS*sizeof(GLfloat), (void*)((from*INSTANCE_FLOATS+4)*sizeof(GLfloat)));
+			glDrawArraysInstanced(GL_TRIANGLES, 0, 36, to - from);
+		}
+		from = to + 1;
+	}
+}
 
+/* Build the glyph atlas of fontfile into a texture, and the VAO the
+   text batches are streamed through */
+void createTextBatch (const char* fontfile)
+{
+	std::string error;
+	if (!buildGlyphAtlas(fontfile, textBatch.Atlas, error)) {
+		cout << "Error: " << error << endl;
+		glfwTerminate();
+		exit(EXIT_FAILURE);
+	}
+	const GlyphAtlas& atlas = textBatch.Atlas;
+	glGenTextures(1, &textBatch.Texture);
+	glBindTexture(GL_TEXTURE_2D, textBatch.Texture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, atlas.width, atlas.height, 0, GL_RED, GL_UNSIGNED_BYTE, &atlas.pixels[0]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenVertexArrays(1, &textBatch.VertexArrayID);
+	glBindVertexArray(textBatch.VertexArrayID);
+	glGenBuffers(1, &textBatch.VertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, textBatch.VertexBuffer);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, Position));
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (void*)offsetof(TextVertex, UV));
+	glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(TextVertex), (void*)offsetof(TextVertex, Color));
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
 }
-float posy[10][10];
+
 void init();
-void level1();
-void level2();
-void level4();
-void level6();
-void level7();
-void level8();
-void level9();
 
 
 
@@ -926,11 +1302,11 @@ void createCircle()
 		color_buffer_data1[i+1]=1;
 		color_buffer_data1[i+2]=0;
 	}
-	circle = create3DObject(GL_TRIANGLES,360*3,vertex_buffer_data,color_buffer_data,GL_FILL);
-	circle1 = create3DObject(GL_TRIANGLES,360*3,vertex_buffer_data,color_buffer_data1,GL_FILL);
+	Mesh *circleMesh = createMesh(360*3,vertex_buffer_data,VERTEX_HALF);
+	circle = create3DObject(GL_TRIANGLES,circleMesh,color_buffer_data,GL_FILL);
+	circle1 = create3DObject(GL_TRIANGLES,circleMesh,color_buffer_data1,GL_FILL);
 
 }
-void level3();
 void createCuboid(){
 	GLfloat vertex_buffer_data [] = {
 		-2.0f,-2.0f,-2.0f, // triangle 1 : begin
@@ -1107,43 +1483,22 @@ void createCuboid(){
 		color_buffer_data8[3*v+2] = 1;
 		}
 	}
-	for(int i=0;i<10;i++)
-		for(int j=0;j<15;j++){
-			if((i+j)%2==0)
-				cuboid[i][j] = create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data1, GL_FILL);
-			else
-				cuboid[i][j] = create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data2, GL_FILL);
-
+	cubeMesh = createMesh(36, vertex_buffer_data, VERTEX_HALF);
+	createBoardMesh(cubeMesh);
+	const GLfloat* palettes[TILE_PALETTES] = { color_buffer_data1, color_buffer_data2, color_buffer_data7, color_buffer_data8 };
+	for(int p=0;p<TILE_PALETTES;p++)
+		for(int k=0;k<36*3;k++)
+			tilePalette[p*36*3+k]=palettes[p][k];
 
-			cub1= create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data3, GL_FILL);
-			cub2= create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data3, GL_FILL);
-			dcu= create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data1, GL_FILL);
-
-			dcub= create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data5, GL_FILL);
-			dcub1= create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data4, GL_FILL);
-			dcub2= create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data5, GL_FILL);
-			dcub3= create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data6, GL_FILL);
-			dcub4= create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data7, GL_FILL);
-			dcub5= create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data8, GL_FILL);
-
-
-
-
-
-		}
-
-		for(int i=0;i<10;i++)
-		for(int j=0;j<15;j++){
-			if((i+j)%2==0)
-				cuboid1[i][j] = create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data3,GL_LINE);
-			else
-				cuboid1[i][j] = create3DObject(GL_TRIANGLES, 36, vertex_buffer_data, color_buffer_data3,GL_LINE);
-
-
-		}
+	// the block's two halves share a material, as do the heavy and even soft switch markers
+	cub1 = create3DObject(GL_TRIANGLES, cubeMesh, color_buffer_data3, GL_FILL);
+	cub2 = cub1;
+	dcub = create3DObject(GL_TRIANGLES, cubeMesh, color_buffer_data5, GL_FILL);
+	dcub1 = create3DObject(GL_TRIANGLES, cubeMesh, color_buffer_data4, GL_FILL);
+	dcub2 = dcub;
+	dcub3 = create3DObject(GL_TRIANGLES, cubeMesh, color_buffer_data6, GL_FILL);
 
 	init();
-	level1();
 }
 
 float camera_rotation_angle = 45;
@@ -1180,328 +1535,26 @@ void mousezoom(GLFWwindow* window, double xoffset, double yoffset)
 }
 /* Render the scene with openGL */
 /* Edit this function according to your assignment */
-int a[10][15];
-void level1(){
-	for(int i=0;i<10;i++)
-		for(int j=0;j<10;j++)
-			a[i][j]=1;
-	for(int i=0;i<2;i++)
-		for(int j=0;j<10;j++)
-			a[i][j]=0;
-	for(int i=9;i>=8;i--)
-		for(int  j=0;j<10;j++)
-			a[i][j]=0;
-	a[6][7]=4;
-	a[6][0]=0;
-	a[6][2]=0;
-	a[6][1]=0;
-	a[6][3]=0;
-	a[6][4]=0;
-	int i=7;
-	for(int j=0;j<6;j++)
-		a[i][j]=0;
-	a[i][9]=0;
-	a[5][0]=0;
-	i=2;
-	for(int j=3;j<10;j++)
-		a[i][j]=0;
-	i=3;
-	for(int j=6;j<10;j++)
-		a[i][j]=0;
-	a[4][9]=0;
-	for(int i=0;i<10;i++)
-		for(int j=10;j<15;j++)
-			a[i][j]=0;
-}
-int l2tog=0,l2f=0;
-int l2togl=0,l2r=0;
-
-
-void level2(){
-	for(int i=0;i<10;i++)
-		for(int j=0;j<15;j++)
-			a[i][j]=1;
-	for(int i=0;i<3;i++)
-		for(int j=0;j<15;j++)
-			a[i][j]=0;
-	for(int i=8;i<10;i++)
-		for(int j=0;j<15;j++)
-			a[i][j]=0;
-	for(int i=3;i<8;i++){
-		a[i][4]=0;
-		a[i][5]=0;
-	}
-	int i=2;
-	for(int j=6;j<15;j++)
-		a[i][j]=1;
-	a[2][10]=0;
-	a[2][11]=0;
-	for(int i=3;i<8;i++)
-		for(int j=10;j<12;j++)
-			a[i][j]=0;
-	a[7][12]=0;
-	a[7][13]=0;
-	a[7][14]=0;
-	a[3][13]=4;
-	a[4][2]=2;
-	l2tog=0;
-	l2f=0;
-	a[3][8]=3;
-	l2r=0;
-	l2togl=0;
-
-}
-void level3(){
-	for(int i=0;i<10;i++){
-		for(int j=0;j<15;j++)
-			a[i][j]=1;
-	}
-	for(int i=0;i<4;i++)
-		for(int j=0;j<15;j++)
-			a[i][j]=0;
-	for(int i=8;i<10;i++)
-		for(int j=0;j<15;j++)
-			a[i][j]=0;
-		for(int i=6;i<8;i++)
-		for(int j=4;j<11;j++)
-			a[i][j]=0;
-		a[7][11]=0;
-		int i=3;
-		for(int j=6;j<15;j++)
-			a[i][j]=1;
-		a[4][4]=0;
-		a[4][5]=0;
-		a[4][9]=0;
-		a[4][10]=0;
-		a[5][9]=0;
-		a[5][10]=0;
-		a[3][13]=0;
-		a[3][14]=0;
-		a[4][13]=0;
-		a[4][14]=0;
-		a[6][13]=4;
-
-
-}
-void level4(){
-	for(int i=0;i<10;i++){
-		for(int j=0;j<15;j++)
-			a[i][j]=1;
-	}
-	int i=0;
-	for(int j=0;j<15;j++)
-		a[i][j]=0;
-	for(int i=1;i<3;i++){
-		for(int j=0;j<3;j++)
-			a[i][j]=0;
-		for(int j=13;j<15;j++)
-			a[i][j]=0;
-	}
-	for(int i=3;i<6;i++)
-		for(int j=4;j<9;j++)
-			a[i][j]=0;
-		a[4][3]=0;
-		a[4][9]=0;
-		a[5][3]=0;
-		a[5][9]=0;
-		a[6][3]=0;
-		a[6][4]=0;
-		a[7][3]=0;
-		a[7][4]=0;
-
-		for(int i=8;i<10;i++)
-		for(int j=0;j<5;j++)
-			a[i][j]=0;
-		for(int i=8;i<10;i++)
-		for(int j=8;j<10;j++)
-			a[i][j]=0;
-		
-		a[8][6]=4;
-		a[8][13]=5;
-		a[6][8]=1;
-		a[6][9]=6;
-		a[7][8]=1;
-		a[7][9]=6;
-		for(int i=1;i<3;i++)
-			for(int j=3;j<10;j++)
-				a[i][j]=6;
-			for(int i=6;i<10;i++)
-			for(int j=9;j<15;j++)
-				a[i][j]=6;
-		a[8][13]=5;
-
-
-}
-void level6(){
-	for(int i=0;i<10;i++){
-		for(int j=0;j<15;j++)
-			a[i][j]=1;
-	}
-	int i;
-	//int i=0;
-	//for(int j=0;j<15;j++)
-	//	a[i][j]=0;
-	for(int i=0;i<3;i++){
-		for(int j=0;j<5;j++)
-			a[i][j]=0;
-	}
-	a[1][6]=0;
-	a[1][7]=0;
-	a[2][6]=0;
-	a[2][7]=0;
-	a[3][6]=0;
-	for(int i=3;i<6;i++){
-		for(int j=7;j<11;j++)
-			a[i][j]=0;
-	}
-	a[6][8]=0;
-	a[6][7]=0;
-	a[5][11]=0;
-	for(i=6;i<9;i++)
-	for(int j=11;j<15;j++)
-		a[i][j]=0;
-	for(i=0;i<2;i++)
-	for(int j=11;j<15;j++)
-		a[i][j]=0;
-	a[2][13]=0,a[2][14]=0;
-	for(i=4;i<9;i++)
-	for(int j=0;j<4;j++)
-		a[i][j]=0;
-	for(i=6;i<9;i++)
-	for(int j=4;j<6;j++)
-		a[i][j]=0;
-	a[9][6]=0;
-	a[9][10]=0;
-	a[4][13]=4;
-	for(int j=0;j<6;j++)
-		a[9][j]=0;
-	for(int j=10;j<15;j++)
-		a[9][j]=0;
-}
-void level7(){
-	for(int i=0;i<10;i++){
-		for(int j=0;j<15;j++)
-			a[i][j]=1;
-	}
-	int i=0;
-	for(int j=0;j<15;j++)
-		a[i][j]=0;
-	i=9;
-	for(int j=0;j<15;j++)
-		a[i][j]=0;
-	for(int i=1;i<3;i++)
-		for(int j=0;j<8;j++)
-		a[i][j]=0;
-	for(int i=1;i<3;i++)
-		for(int j=12;j<15;j++)
-		a[i][j]=0;
-	i=3;
-		for(int j=3;j<8;j++)
-		a[i][j]=0;
-	a[3][9]=0;
-	a[3][10]=0;
-	a[4][9]=0;
-	for(int i=4;i<7;i++)
-		for(int j=10;j<12;j++)
-		a[i][j]=0;
-	for(int i=5;i<8;i++)
-		for(int j=3;j<7;j++)
-		a[i][j]=0;
-	for(int i=7;i<9;i++)
-		for(int j=9;j<15;j++)
-		a[i][j]=0;
-	a[4][13]=4;
-	a[5][9]=2;
-
-}
-void level8(){
-	for(int i=0;i<10;i++){
-		for(int j=0;j<15;j++)
-			a[i][j]=0;
-	}
-	for(int i=4;i<7;i++){
-		for(int j=0;j<6;j++)
-			a[i][j]=1;
-	}
-	for(int i=1;i<10;i++){
-		for(int j=9;j<12;j++)
-			a[i][j]=1;
-	}
-	for(int i=4;i<7;i++){
-		for(int j=12;j<15;j++)
-			a[i][j]=1;
-	}
-	a[5][13]=4;
-	a[5][4]=7;
-l8f=0;
-}
 int sound=0;
-void level9(){
-	for(int i=0;i<10;i++){
-		for(int j=0;j<15;j++)
-			a[i][j]=0;
-	}
-	for(int i=3;i<6;i++){
-		for(int j=0;j<4;j++)
-			a[i][j]=1;
-	}
-	for(int i=3;i<6;i++){
-		for(int j=11;j<15;j++)
-			a[i][j]=1;
-	}
-	for(int i=5;i<6;i++){
-		for(int j=4;j<15;j++)
-			a[i][j]=1;
-	}
-	a[3][7]=1;
-	a[4][7]=1;
-	a[6][6]=1,a[7][6]=1,a[6][8]=1,a[7][8]=1,a[6][7]=4;
-	a[7][7]=1;
-	a[4][13]=7;
-
-}
-float spo;
 int attempts=1;
 void init(){
-	for(int i=0;i<15;i++)
-		for(int j=0;j<10;j++)
-			posy[i][j]=-60;
-
 sound=0;
-	//posy[0][0]=0;
 	spo=60;
-	posx1=0;
-	posx2=0;
-	posz1=0;
-	posz2=0;
 	posy1=0;
 	posy2=6;
-	disable=0;
 
 dis=1;
 stmove=0;
-if(flag==1){
-			level1();
-		}
-		if(flag==2)
-			level2();
-		if(flag==3)
-			level3();
-		if(flag==4)
-			level4();
-		if(flag==5)
-			level6();
-		if(flag==6)
-			level7();
-		if(flag==7)
-			level8();
-		if(flag==8)
-			level9();
-
-
+	// Straight from the mapped pack: no parsing, and board's storage is
+	// reused. Play needs no transition table, so none is built.
+	if(flag<1 || flag>lastStage || !stagePack.read(flag-1,board))
+		resetLevel(board,BOARD_COLS,BOARD_ROWS);
+	block=startState(board);
+	loadBoardMesh();
+	snapBlock();
 }
 
-double current_time,utime=glfwGetTime();
+double current_time,utime=0;	// gameTime the level banner went up
 int flagdown=0;
 
 glm::vec3 getRGBfromHue (int hue)
@@ -1540,7 +1593,7 @@ void display_string(GLFWwindow *window){
 
 }
 float camera_rotation_angle1=0;
-double utime1;
+double utime1;			// gameTime the game, or its end screen, started
 double utime4=glfwGetTime();
 int score=0;
 int heli=0;
@@ -1553,6 +1606,92 @@ void drag (GLFWwindow* window){
 	camera_rotation_angle1-=(lx1-lxg)/800;
 }
 	}
+/* Menu, level banner and end screen changes; draw() only shows them */
+static void updateScreens ()
+{
+	heli=(view!=0);
+	if(attempts==4){
+		flag=lastStage+1;
+		utime1=gameTime;
+	}
+	if(flag>lastStage){
+		moves=0;
+		score=0;
+		if(attempts>3)
+			attempts=5;
+		dis=1;
+		ent=0;
+		enter=0;
+		pass=0;
+		if(gameTime-utime1>3){
+			flag=1;
+			blo=0;
+			init();
+		}
+	}
+	if(blo==0){
+		if(enter==1){
+			blo=1;
+			utime=gameTime;
+			utime1=gameTime;
+		}
+		if(ent==1 && ab[0]>='1' && ab[0]-'0'<=lastStage){
+			flag=ab[0]-'0';
+			init();
+			blo=1;
+			utime1=gameTime;
+			utime=gameTime;
+		}
+	}
+	if(dis==1 && blo==1 && gameTime-utime>2){
+		utime=gameTime;
+		dis=0;
+	}
+}
+
+/* One fixed step of the screens, of the block dropping onto the board,
+   and of it sinking after a fall or a win */
+void simulate ()
+{
+	snapBlock();
+	updateScreens();
+	if(dis!=0 || blo!=1)
+		return;
+	spo=max(0.0f, spo-DROP_IN_SPEED*(float)TICK);
+	if(block.status==STATUS_FELL){
+		if(soff==0)
+			playSound(SOUND_SWITCH);
+		posy1-=SINK_SPEED*TICK;
+		posy2-=SINK_SPEED*TICK;
+		if(posy1<-15){
+			view=0;
+			attempts++;
+			score-=10;
+			moves-=stmove;
+			init();
+			if(flag>lastStage)
+				utime1=gameTime;
+		}
+	}
+	if(block.status==STATUS_WON){
+		attempts=1;
+		if(sound==0){
+			if(soff==0)
+				playSound(SOUND_FINISH);
+			sound=1;
+		}
+		posy1-=SINK_SPEED*TICK;
+		posy2-=SINK_SPEED*TICK;
+		if(posy1<-20){
+			flag++;
+			score+=100;
+			init();
+		}
+		if(flag>lastStage)
+			utime1=gameTime;
+	}
+}
+
 void draw ()
 {
 
@@ -1560,9 +1699,9 @@ void draw ()
 	
 	glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	// use the loaded shader program
-	// Don't change unless you know what you are doing
-	glUseProgram (programID);
+	// model creation and the last frame's text left GL in an unknown state
+	invalidateState();
+
 
 	// Eye - Location of camera. Don't change unless you are sure!!
 	glm::vec3 eye ( 5*cos(camera_rotation_angle*M_PI/180.0f), 0, 5*sin(camera_rotation_angle*M_PI/180.0f) );
@@ -1575,74 +1714,51 @@ void draw ()
 	//Matrices.view = glm::lookAt(glm::vec3(-30,70,60), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
 
 	//Matrices.projection = glm::perspective(0.9f+zoom, (GLfloat) 1500 / (GLfloat) 800, 0.1f, 500.0f);
-	if(attempts==4){
-		flag=9;
-		utime1=glfwGetTime();
-
-	}
-
 	if(dis==0)
 	Matrices.view = glm::lookAt(glm::vec3(-30,70,60), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
 	if(dis==1 || blo==0)
-Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); 
+useHudCamera();
 	
 	if(view==0){
 	Matrices.view = glm::lookAt(glm::vec3(-30,70,60), glm::vec3(0,0,0), glm::vec3(0,1,0));
 	Matrices.projection = glm::ortho((float)(-100.0f/zoom), (float)(100.0f/zoom), (float)(-50.0f/zoom), (float)(50.0f/zoom), 0.1f, 500.0f);
-	heli=0;
 
 }
 	if(view==1){
-		heli=1;
 	//Matrices.projection = glm::ortho(-100.0f,100.0f,-50.0f,50.0f,0.1f, 500.0f);
-	//glm::mat4 translateTriangle1 = glm::translate (glm::vec3(-18.0f+posx1+l3+l6+l7, 3.0f+posy1+spo, -6.0f+posz1+r3+r4+r6+r7+r8+r9)); // glTranslatef
 
 	Matrices.projection = glm::perspective(0.9f+0.6f, (GLfloat) 1500 / (GLfloat) 800, 0.1f, 500.0f);
 
-	Matrices.view = glm::lookAt(glm::vec3(-8+posx1+l3+l6+l7,15,-4+posz1+r3+r4+r6+r7+r8+r9), glm::vec3(30,0,10), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
+	Matrices.view = glm::lookAt(glm::vec3(6*block.x-24+10+board.cameraX,15,6*block.z-24+2+board.cameraZ), glm::vec3(30,0,10), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
 	}
 	if(view==2){
-		heli=1;
 	//Matrices.projection = glm::perspective(0.9f, (GLfloat) 1500 / (GLfloat) 800, 0.1f, 500.0f);
 	Matrices.projection = glm::ortho(-100.0f,100.0f,-50.0f,50.0f,0.1f, 500.0f);
 	
 	Matrices.view = glm::lookAt(glm::vec3(0,90,0), glm::vec3(0,0,0), glm::vec3(0,0,-1)); 
 	}
 	if(view==3){
-		heli=1;
 	Matrices.projection = glm::perspective(0.9f+0.3f, (GLfloat) 1500 / (GLfloat) 800, 0.1f, 500.0f);
-	Matrices.view = glm::lookAt(glm::vec3(-33+posx1+l3+l6+l7,24,-8+posz1+r3+r4+r6+r7+r8+r9), glm::vec3(30,0,10), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
+	Matrices.view = glm::lookAt(glm::vec3(6*block.x-24-15+board.cameraX,24,6*block.z-24-2+board.cameraZ), glm::vec3(30,0,10), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
 
 	} 
     if(view==4){
-    	heli=1;
 	Matrices.projection = glm::ortho(-100.0f/zoom,100.0f/zoom,-50.0f/zoom,50.0f/zoom,0.1f, 500.0f);
 
 	Matrices.view = glm::lookAt(glm::vec3(-30*cos(camera_rotation_angle*M_PI/180),70,60*sin(camera_rotation_angle*M_PI/180)), glm::vec3(0,0,0), glm::vec3(0,1,0));
 	} 
-	// Compute ViewProject matrix as view/camera might not be changed for this frame (basic scenario)
+	// Upload the ViewProject matrices once; each model then only sends its model matrix
 	//  Don't change unless you are sure!!
-	glm::mat4 VP = Matrices.projection * Matrices.view;
-
-	// Send our transformation to the currently bound shader, in the "MVP" uniform
-	// For each model you render, since the MVP will be different (at least the M part)
-	//  Don't change unless you are sure!!
-	glm::mat4 MVP;	
+	uploadFrame(Matrices.view);
 
 	// Compute Camera matrix (view)
 	// Matrices.view = glm::lookAt( eye, target, up ); // Rotating Camera for 3D
 	//  Don't change unless you are sure!!
-	if(flag==9){
+	if(flag>lastStage){
 		
-		for(int i=0;i<10;i++)
-			for(int j=0;j<15;j++)
-				a[i][j]=0;
-moves=0;
-score=0;
 float fontScaleValue = 36;
 int fontScale=150;
 	glm::vec3 fontColor1= getRGBfromHue(fontScale);
-	glUseProgram(fontProgramID);
 
 
 	char level_strl[30],level_strl1[30];
@@ -1650,38 +1766,19 @@ int fontScale=150;
 	if(attempts<=3)
 	sprintf(level_strl,"YOU WIN");
 	if(attempts>3){
-Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); 
-	//attempts=5;
+useHudCamera();
 	sprintf(level_strl,"YOU LOOSE");
-	attempts=5;
 }
 
 
-glUseProgram(fontProgramID);
 
 	// Transform the text
 	Matrices.model = glm::mat4(1.0f);
 	glm::mat4 translateText = glm::translate(glm::vec3(-40,4,0));
 	glm::mat4 scaleText = glm::scale(glm::vec3(fontScaleValue,fontScaleValue,fontScaleValue));
 	Matrices.model *= (translateText * scaleText);
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
-	// send font's MVP and font color to fond shaders
-	glUniformMatrix4fv(GL3Font.fontMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniform3fv(GL3Font.fontColorID, 1, &fontColor1[0]);
-	GL3Font.font->Render(level_strl);
-	dis=1;
-	ent=0;
-	enter=0;
-	pass=0;
-	l3=0,r3=0,l6=0,r6=0,l7=0,r7=0,r8=0,r9=0;
-	double ctime=glfwGetTime();
-	if(ctime-utime1>3){
-	//	re=1;
-		flag=1;
-		blo=0;
-		init();
-
-	}
+	// send font's model matrix and font color to fond shaders
+	drawText(level_strl, fontColor1, frame.Hud);
 		
 
 	}
@@ -1691,7 +1788,6 @@ glUseProgram(fontProgramID);
 		float fontScaleValue = 36;
 int fontScale=150;
 	glm::vec3 fontColor1= getRGBfromHue(fontScale);
-	glUseProgram(programID);
 
 
 	char level_strl[30],level_strl1[30];
@@ -1706,11 +1802,9 @@ int fontScale=150;
 
 
 
-	glUseProgram(fontProgramID);
 
 
-Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); 
-	glUseProgram(programID);
+useHudCamera();
 	Matrices.model = glm::mat4(1.0f);
 					
 glm::mat4 translateTriangle2 = glm::translate (glm::vec3(-5,-8,0)); // glTranslatef
@@ -1719,11 +1813,9 @@ glm::mat4 translateTriangle2 = glm::translate (glm::vec3(-5,-8,0)); // glTransla
 				// rotate about vector (1,0,0)
 				glm::mat4 triangleTransform2 = translateTriangle2 * rotateTriangle2*scaleTriangle2;
 				Matrices.model *= triangleTransform2; 
-				MVP = Matrices.projection * Matrices.view * Matrices.model; // MVP = p * V * M
 
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
 
-				draw3DObject(rectangle);
+				drawObject(rectangle, frame.Hud);
 // Fixed camera for 2D (ortho) in XY plane
 Matrices.model = glm::mat4(1.0f);
 					
@@ -1733,12 +1825,10 @@ glm::mat4 translateTriangle1 = glm::translate (glm::vec3(-3,-8,0)); // glTransla
 				// rotate about vector (1,0,0)
 				glm::mat4 triangleTransform1 = translateTriangle1 * rotateTriangle1*scaleTriangle1;
 				Matrices.model *= triangleTransform1; 
-				MVP = Matrices.projection * Matrices.view * Matrices.model; // MVP = p * V * M
 
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
 				if(!togtext)
 
-				draw3DObject(rectangle1);
+				drawObject(rectangle1, frame.Hud, LAYER_OVERLAY);
 
 
 				Matrices.model = glm::mat4(1.0f);
@@ -1749,11 +1839,9 @@ glm::mat4 translateTriangle3 = glm::translate (glm::vec3(-3,-18,0)); // glTransl
 				// rotate about vector (1,0,0)
 				glm::mat4 triangleTransform3 = translateTriangle3 * rotateTriangle3*scaleTriangle3;
 				Matrices.model *= triangleTransform3; 
-				MVP = Matrices.projection * Matrices.view * Matrices.model; // MVP = p * V * M
 
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
 				if(!togtext)
-				draw3DObject(rectangle1);
+				drawObject(rectangle1, frame.Hud, LAYER_OVERLAY);
 
 				Matrices.model = glm::mat4(1.0f);
 					
@@ -1763,12 +1851,10 @@ glm::mat4 translateTriangle4 = glm::translate (glm::vec3(-3,-28,0)); // glTransl
 				// rotate about vector (1,0,0)
 				glm::mat4 triangleTransform4 = translateTriangle4 * rotateTriangle4*scaleTriangle4;
 				Matrices.model *= triangleTransform4; 
-				MVP = Matrices.projection * Matrices.view * Matrices.model; // MVP = p * V * M
 
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
 
 				if(!togtext)
-				draw3DObject(rectangle1);
+				drawObject(rectangle1, frame.Hud, LAYER_OVERLAY);
 
 			Matrices.model = glm::mat4(1.0f);
 					
@@ -1778,24 +1864,18 @@ glm::mat4 translateTriangle5 = glm::translate (glm::vec3(-53,-28,0)); // glTrans
 				// rotate about vector (1,0,0)
 				glm::mat4 triangleTransform5 = translateTriangle5 * rotateTriangle5*scaleTriangle5;
 				Matrices.model *= triangleTransform5; 
-				MVP = Matrices.projection * Matrices.view * Matrices.model; // MVP = p * V * M
 
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
 
 				if(togtext)
-				draw3DObject(rectangle1);
-	glUseProgram(fontProgramID);
+				drawObject(rectangle1, frame.Hud, LAYER_OVERLAY);
 
 	// Transform the text
 	Matrices.model = glm::mat4(1.0f);
 	glm::mat4 translateText = glm::translate(glm::vec3(-40,4,0));
 	glm::mat4 scaleText = glm::scale(glm::vec3(fontScaleValue,fontScaleValue,fontScaleValue));
 	Matrices.model *= (translateText * scaleText);
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
-	// send font's MVP and font color to fond shaders
-	glUniformMatrix4fv(GL3Font.fontMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniform3fv(GL3Font.fontColorID, 1, &fontColor1[0]);
-	GL3Font.font->Render(level_strl);
+	// send font's model matrix and font color to fond shaders
+	drawText(level_strl, fontColor1, frame.Hud);
 	int fontScale1=5;
 	fontScaleValue=8;
 	glm::vec3 fontColor= getRGBfromHue(fontScale1);
@@ -1804,12 +1884,9 @@ glm::mat4 translateTriangle5 = glm::translate (glm::vec3(-53,-28,0)); // glTrans
 	glm::mat4 translateText1 = glm::translate(glm::vec3(-20,-10,0));
 	glm::mat4 scaleText1 = glm::scale(glm::vec3(fontScaleValue,fontScaleValue,fontScaleValue));
 	Matrices.model *= (translateText1 * scaleText1);
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
-	// send font's MVP and font color to fond shaders
-	glUniformMatrix4fv(GL3Font.fontMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniform3fv(GL3Font.fontColorID, 1, &fontColor[0]);
+	// send font's model matrix and font color to fond shaders
 	if(!togtext)
-	GL3Font.font->Render(level_strl1);
+	drawText(level_strl1, fontColor, frame.Hud);
 
 	glm::vec3 fontColor2= getRGBfromHue(fontScale1);
 
@@ -1817,12 +1894,9 @@ glm::mat4 translateTriangle5 = glm::translate (glm::vec3(-53,-28,0)); // glTrans
 	glm::mat4 translateText2 = glm::translate(glm::vec3(-15,-20,0));
 	glm::mat4 scaleText2 = glm::scale(glm::vec3(fontScaleValue,fontScaleValue,fontScaleValue));
 	Matrices.model *= (translateText2 * scaleText2);
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
-	// send font's MVP and font color to fond shaders
-	glUniformMatrix4fv(GL3Font.fontMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniform3fv(GL3Font.fontColorID, 1, &fontColor2[0]);
+	// send font's model matrix and font color to fond shaders
 	if(!togtext)
-	GL3Font.font->Render(level_strl2);
+	drawText(level_strl2, fontColor2, frame.Hud);
 
 
 	
@@ -1833,12 +1907,9 @@ glm::mat4 translateTriangle5 = glm::translate (glm::vec3(-53,-28,0)); // glTrans
 	glm::mat4 translateText3 = glm::translate(glm::vec3(-15,-30,0));
 	glm::mat4 scaleText3 = glm::scale(glm::vec3(fontScaleValue,fontScaleValue,fontScaleValue));
 	Matrices.model *= (translateText3 * scaleText3);
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
-	// send font's MVP and font color to fond shaders
-	glUniformMatrix4fv(GL3Font.fontMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniform3fv(GL3Font.fontColorID, 1, &fontColor3[0]);
+	// send font's model matrix and font color to fond shaders
 	if(!togtext)
-	GL3Font.font->Render(level_strl3);
+	drawText(level_strl3, fontColor3, frame.Hud);
 fontScale1=100;
 	fontScaleValue=6;
 glm::vec3 fontColor4= getRGBfromHue(fontScale1);
@@ -1847,12 +1918,9 @@ glm::vec3 fontColor4= getRGBfromHue(fontScale1);
 	glm::mat4 translateText4 = glm::translate(glm::vec3(-85,-15,0));
 	glm::mat4 scaleText4 = glm::scale(glm::vec3(fontScaleValue,fontScaleValue,fontScaleValue));
 	Matrices.model *= (translateText4 * scaleText4);
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
-	// send font's MVP and font color to fond shaders
-	glUniformMatrix4fv(GL3Font.fontMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniform3fv(GL3Font.fontColorID, 1, &fontColor4[0]);
+	// send font's model matrix and font color to fond shaders
 	if(togtext)
-	GL3Font.font->Render(level_strl4);
+	drawText(level_strl4, fontColor4, frame.Hud);
 
 
 fontScale1=0;
@@ -1863,118 +1931,14 @@ glm::vec3 fontColor5= getRGBfromHue(fontScale1);
 	glm::mat4 translateText5 = glm::translate(glm::vec3(-58,-29.5,0));
 	glm::mat4 scaleText5 = glm::scale(glm::vec3(fontScaleValue,fontScaleValue,fontScaleValue));
 	Matrices.model *= (translateText5 * scaleText5);
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
-	// send font's MVP and font color to fond shaders
-	glUniformMatrix4fv(GL3Font.fontMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniform3fv(GL3Font.fontColorID, 1, &fontColor5[0]);
+	// send font's model matrix and font color to fond shaders
 	if(togtext)
-	GL3Font.font->Render(level_strl5);
-
-	//double ctime=glfwGetTime();
-	if(enter==1){
-		blo=1;
-		
-		utime=glfwGetTime();
-		utime1=glfwGetTime();
-
-	}
-	if(ent==1){
-			//cout<<"yes";
-		if(ab[0]=='1'){
-				flag=1;
-				level1();
-				blo=1;
-		utime1=glfwGetTime();
-		utime=glfwGetTime();
-
-			}
-			if(ab[0]=='2'){
-				flag=2;
-				level2();
-				blo=1;
-		utime1=glfwGetTime();
-		utime=glfwGetTime();
-
-			}
-			if(ab[0]=='3'){
-				flag=3;
-				level3();
-				blo=1;
-		utime1=glfwGetTime();
-		utime=glfwGetTime();
-		l3=0;
-			r3=18;
-
-			}
-			if(ab[0]=='4'){
-				flag=4;
-				level4();
-				blo=1;
-		utime1=glfwGetTime();
-		utime=glfwGetTime();
-		l3=0;
-			r3=18;
-
-
-			}
-			if(ab[0]=='5'){
-				flag=5;
-				level6();
-				blo=1;
-		utime1=glfwGetTime();
-		utime=glfwGetTime();
-		l3=-6;
-			r3=0;
-
-
-			}
-			if(ab[0]=='6'){
-				flag=6;
-				level7();
-				blo=1;
-		utime1=glfwGetTime();
-		utime=glfwGetTime();
-		l3=0;
-			r3=18;
-			l6=-6;
-			r6=-18;
-
-			}
-			if(ab[0]=='7'){
-				flag=7;
-				level8();
-				blo=1;
-		utime1=glfwGetTime();
-		utime=glfwGetTime();
-		l3=0;
-			r3=18;
-			l6=-6;
-			r6=-18;
-			l7=6;
-			r7=6;
-
-			}
-			if(ab[0]=='8'){
-				flag=8;
-				level9();
-				blo=1;
-		utime1=glfwGetTime();
-		utime=glfwGetTime();
-		l3=0;
-			r3=18;
-l6=0;
-			r6=-12;
-
-			}
-
-		}
-
+	drawText(level_strl5, fontColor5, frame.Hud);
 
 	}
 
 		
 	if(pass==1 && blo==0){
-	glUseProgram(programID);
 
 		Matrices.model = glm::mat4(1.0f);
 					
@@ -1984,44 +1948,36 @@ glm::mat4 translateTriangle1 = glm::translate (glm::vec3(33,-22,0)); // glTransl
 				// rotate about vector (1,0,0)
 				glm::mat4 triangleTransform1 = translateTriangle1 * rotateTriangle1*scaleTriangle1;
 				Matrices.model *= triangleTransform1; 
-				MVP = Matrices.projection * Matrices.view * Matrices.model; // MVP = p * V * M
 
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
 
-				draw3DObject(rectangle1);
+				drawObject(rectangle1, frame.Hud, LAYER_OVERLAY);
 
 				float fontScaleValue = 12 ;
 int fontScale=280;
 	glm::vec3 fontColor= getRGBfromHue(fontScale);
-	glUseProgram(fontProgramID);
 
-Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
+useHudCamera();
 
 	// Transform the text
 	Matrices.model = glm::mat4(1.0f);
 	glm::mat4 translateText = glm::translate(glm::vec3(30,-20,0));
 	glm::mat4 scaleText = glm::scale(glm::vec3(fontScaleValue,fontScaleValue,fontScaleValue));
 	Matrices.model *= (translateText * scaleText);
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
-	// send font's MVP and font color to fond shaders
-	glUniformMatrix4fv(GL3Font.fontMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniform3fv(GL3Font.fontColorID, 1, &fontColor[0]);
-	GL3Font.font->Render(ab);
+	// send font's model matrix and font color to fond shaders
+	drawText(ab, fontColor, frame.Hud);
 				
 				
 
 	}
 	if(dis==0 && blo==1){
-		int ti=glfwGetTime();
+		int ti=gameTime-utime1;
 		int ti1,ti2,ti3;
-		ti-=utime1;
 		ti1=ti/3600;
 		ti2=ti/60;
 		ti3=(ti-(ti2*60));
 float fontScaleValue = 12 ;
 int fontScale=280;
 	glm::vec3 fontColor= getRGBfromHue(fontScale);
-	glUseProgram(fontProgramID);
 
 
 	char level_strl[30];
@@ -2030,18 +1986,15 @@ int fontScale=280;
 
 
 
-Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
+useHudCamera();
 
 	// Transform the text
 	Matrices.model = glm::mat4(1.0f);
 	glm::mat4 translateText = glm::translate(glm::vec3(48,42,0));
 	glm::mat4 scaleText = glm::scale(glm::vec3(fontScaleValue,fontScaleValue,fontScaleValue));
 	Matrices.model *= (translateText * scaleText);
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
-	// send font's MVP and font color to fond shaders
-	glUniformMatrix4fv(GL3Font.fontMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniform3fv(GL3Font.fontColorID, 1, &fontColor[0]);
-	GL3Font.font->Render(level_strl);
+	// send font's model matrix and font color to fond shaders
+	drawText(level_strl, fontColor, frame.Hud);
 
 
 
@@ -2049,7 +2002,6 @@ Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)
 	 fontScaleValue = 12 ;
  fontScale=280;
 	glm::vec3 fontColor3= getRGBfromHue(fontScale);
-	glUseProgram(fontProgramID);
 
 
 	char level_strl3[30];
@@ -2058,20 +2010,16 @@ Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)
 
 
 
-Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
+useHudCamera();
 
 	// Transform the text
 	Matrices.model = glm::mat4(1.0f);
 	glm::mat4 translateText4 = glm::translate(glm::vec3(-68,42,0));
 	glm::mat4 scaleText4 = glm::scale(glm::vec3(fontScaleValue,fontScaleValue,fontScaleValue));
 	Matrices.model *= (translateText4 * scaleText4);
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
-	// send font's MVP and font color to fond shaders
-	glUniformMatrix4fv(GL3Font.fontMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniform3fv(GL3Font.fontColorID, 1, &fontColor3[0]);
-	GL3Font.font->Render(level_strl3);
+	// send font's model matrix and font color to fond shaders
+	drawText(level_strl3, fontColor3, frame.Hud);
 
-glUseProgram(programID);
 	Matrices.model = glm::mat4(1.0f);
 					
 glm::mat4 translateTriangle1 = glm::translate (glm::vec3(-83,44.5,0)); // glTranslatef
@@ -2080,17 +2028,14 @@ glm::mat4 translateTriangle1 = glm::translate (glm::vec3(-83,44.5,0)); // glTran
 				// rotate about vector (1,0,0)
 				glm::mat4 triangleTransform1 = translateTriangle1 * rotateTriangle1*scaleTriangle1;
 				Matrices.model *= triangleTransform1; 
-				MVP = Matrices.projection * Matrices.view * Matrices.model; // MVP = p * V * M
 
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
 
-				draw3DObject(rectangle2);
+				drawObject(rectangle2, frame.Hud, LAYER_OVERLAY);
 
 
 	fontScaleValue = 8 ;
  fontScale=100;
 	glm::vec3 fontColor4= getRGBfromHue(fontScale);
-	glUseProgram(fontProgramID);
 
 
 	char level_strl4[30];
@@ -2099,21 +2044,17 @@ glm::mat4 translateTriangle1 = glm::translate (glm::vec3(-83,44.5,0)); // glTran
 
 
 
-Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
+useHudCamera();
 
 	// Transform the text
 	Matrices.model = glm::mat4(1.0f);
 	glm::mat4 translateText5 = glm::translate(glm::vec3(-88,43,0));
 	glm::mat4 scaleText5 = glm::scale(glm::vec3(fontScaleValue,fontScaleValue,fontScaleValue));
 	Matrices.model *= (translateText5 * scaleText5);
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
-	// send font's MVP and font color to fond shaders
-	glUniformMatrix4fv(GL3Font.fontMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniform3fv(GL3Font.fontColorID, 1, &fontColor4[0]);
-	GL3Font.font->Render(level_strl4);
+	// send font's model matrix and font color to fond shaders
+	drawText(level_strl4, fontColor4, frame.Hud);
 	if(menu==1){
 		//char level_strl5[30];
-		glUseProgram(programID);
 	Matrices.model = glm::mat4(1.0f);
 					
 glm::mat4 translateTriangle1 = glm::translate (glm::vec3(-73,6,0)); // glTranslatef
@@ -2122,15 +2063,12 @@ glm::mat4 translateTriangle1 = glm::translate (glm::vec3(-73,6,0)); // glTransla
 				// rotate about vector (1,0,0)
 				glm::mat4 triangleTransform1 = translateTriangle1 * rotateTriangle1*scaleTriangle1;
 				Matrices.model *= triangleTransform1; 
-				MVP = Matrices.projection * Matrices.view * Matrices.model; // MVP = p * V * M
 
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
 
-				draw3DObject(rectangle);
+				drawObject(rectangle, frame.Hud);
 fontScaleValue = 6 ;
  fontScale=100;
 	glm::vec3 fontColor4= getRGBfromHue(fontScale);
-	glUseProgram(fontProgramID);
 
 
 	char level_strl4[30];
@@ -2140,24 +2078,20 @@ fontScaleValue = 6 ;
 
 
 
-Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
+useHudCamera();
 
 	// Transform the text
 	Matrices.model = glm::mat4(1.0f);
 	glm::mat4 translateText5 = glm::translate(glm::vec3(-83,14,0));
 	glm::mat4 scaleText5 = glm::scale(glm::vec3(fontScaleValue,fontScaleValue,fontScaleValue));
 	Matrices.model *= (translateText5 * scaleText5);
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
-	// send font's MVP and font color to fond shaders
-	glUniformMatrix4fv(GL3Font.fontMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniform3fv(GL3Font.fontColorID, 1, &fontColor4[0]);
-	GL3Font.font->Render(level_strl4);
+	// send font's model matrix and font color to fond shaders
+	drawText(level_strl4, fontColor4, frame.Hud);
 
 
 fontScaleValue = 6 ;
  fontScale=100;
 	glm::vec3 fontColor5= getRGBfromHue(fontScale);
-	glUseProgram(fontProgramID);
 
 
 	char level_strl5[30];
@@ -2166,24 +2100,20 @@ fontScaleValue = 6 ;
 
 
 
-Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
+useHudCamera();
 
 	// Transform the text
 	Matrices.model = glm::mat4(1.0f);
 	glm::mat4 translateText6 = glm::translate(glm::vec3(-78,8,0));
 	glm::mat4 scaleText6 = glm::scale(glm::vec3(fontScaleValue,fontScaleValue,fontScaleValue));
 	Matrices.model *= (translateText6 * scaleText6);
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
-	// send font's MVP and font color to fond shaders
-	glUniformMatrix4fv(GL3Font.fontMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniform3fv(GL3Font.fontColorID, 1, &fontColor5[0]);
-	GL3Font.font->Render(level_strl5);
+	// send font's model matrix and font color to fond shaders
+	drawText(level_strl5, fontColor5, frame.Hud);
 
 
 	fontScaleValue = 6 ;
  fontScale=100;
 	glm::vec3 fontColor6= getRGBfromHue(fontScale);
-	glUseProgram(fontProgramID);
 
 
 	char level_strl6[30];
@@ -2192,24 +2122,20 @@ Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)
 
 
 
-Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
+useHudCamera();
 
 	// Transform the text
 	Matrices.model = glm::mat4(1.0f);
 	glm::mat4 translateText7 = glm::translate(glm::vec3(-81,2,0));
 	glm::mat4 scaleText7 = glm::scale(glm::vec3(fontScaleValue,fontScaleValue,fontScaleValue));
 	Matrices.model *= (translateText7 * scaleText7);
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
-	// send font's MVP and font color to fond shaders
-	glUniformMatrix4fv(GL3Font.fontMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniform3fv(GL3Font.fontColorID, 1, &fontColor6[0]);
-	GL3Font.font->Render(level_strl6);
+	// send font's model matrix and font color to fond shaders
+	drawText(level_strl6, fontColor6, frame.Hud);
 
 
 	fontScaleValue = 6 ;
  fontScale=100;
 	glm::vec3 fontColor7= getRGBfromHue(fontScale);
-	glUseProgram(fontProgramID);
 
 
 	char level_strl7[30];
@@ -2218,18 +2144,15 @@ Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)
 
 
 
-Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
+useHudCamera();
 
 	// Transform the text
 	Matrices.model = glm::mat4(1.0f);
 	glm::mat4 translateText8 = glm::translate(glm::vec3(-81,-4,0));
 	glm::mat4 scaleText8 = glm::scale(glm::vec3(fontScaleValue,fontScaleValue,fontScaleValue));
 	Matrices.model *= (translateText8 * scaleText8);
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
-	// send font's MVP and font color to fond shaders
-	glUniformMatrix4fv(GL3Font.fontMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniform3fv(GL3Font.fontColorID, 1, &fontColor7[0]);
-	GL3Font.font->Render(level_strl7);
+	// send font's model matrix and font color to fond shaders
+	drawText(level_strl7, fontColor7, frame.Hud);
 
 
 	}
@@ -2240,150 +2163,45 @@ Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)
 
 
 	if(dis==1 && blo==1){
-double ctime=glfwGetTime();
-		if(ctime - utime > 2){
-			utime=glfwGetTime();
-			dis=0;
 
-		}
-
-	// Send our transformation to the currently bound shader, in the "MVP" uniform
-	// For each model you render, since the MVP will be different (at least the M part)
+	// Send our transformation to the currently bound shader, in the "M" uniform
+	// The camera comes from the Frame block uploaded at the top of draw()
 	//  Don't change unless you are sure!!
 		int fontScale=1;
 float fontScaleValue = 36 ;
 	glm::vec3 fontColor = getRGBfromHue(fontScale);
-	glUseProgram(fontProgramID);
 
 
 	char level_str[30];
 	sprintf(level_str,"LEVEL: %d",flag);
 	
 
-	Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
+	useHudCamera();
 
 	// Transform the text
 	Matrices.model = glm::mat4(1.0f);
 	glm::mat4 translateText = glm::translate(glm::vec3(-40,5,0));
 	glm::mat4 scaleText = glm::scale(glm::vec3(fontScaleValue,fontScaleValue,fontScaleValue));
 	Matrices.model *= (translateText * scaleText);
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
-	// send font's MVP and font color to fond shaders
-	glUniformMatrix4fv(GL3Font.fontMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniform3fv(GL3Font.fontColorID, 1, &fontColor[0]);
-	if(flag<9)
-	GL3Font.font->Render(level_str);
+	// send font's model matrix and font color to fond shaders
+	if(flag<=lastStage)
+	drawText(level_str, fontColor, frame.Hud);
 	}
 	else if(dis==0 && blo==1){
-	glUseProgram (programID);
-
-
-
-	// Load identity to model matrix
-	for(int i=0;i<10;i++){
-		for(int j=0;j<15;j++)
-		{
-			if(a[i][j]==1 ||a[i][j]==2 || a[i][j]==3 ||a[i][j]==6){ 
-
-
-				Matrices.model = glm::mat4(1.0f);
-				posy[i][j]+=((i+j)/1.5);
-				if(posy[i][j]>0)
-					posy[i][j]=0;
-				if(flag==4 && a[i][j]==6){
-
-
-
-					if((i+j)%2==0){
-						Matrices.model = glm::mat4(1.0f);
-					
-glm::mat4 translateTriangle1 = glm::translate (glm::vec3(0.0f+(j+1)*6-30, 0.0+posy[i][j], 0.0f+(i+1)*6-30)); // glTranslatef
-				glm::mat4 rotateTriangle1 = glm::rotate((float)(0*M_PI/180.0f), glm::vec3(0,0,1));
-				glm::mat4 scaleTriangle1 = glm::scale (glm::vec3(1.5f, 0.4f, 1.5f)); // glTranslatef
-				// rotate about vector (1,0,0)
-				glm::mat4 triangleTransform1 = translateTriangle1 * rotateTriangle1*scaleTriangle1;
-				Matrices.model *= triangleTransform1; 
-				MVP = VP * Matrices.model; // MVP = p * V * M
-
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-				draw3DObject(dcub4);
-			}
 
 
-			else
-			{
-				Matrices.model = glm::mat4(1.0f);
-					
-glm::mat4 translateTriangle1 = glm::translate (glm::vec3(0.0f+(j+1)*6-30, 0.0+posy[i][j], 0.0f+(i+1)*6-30)); // glTranslatef
-				glm::mat4 rotateTriangle1 = glm::rotate((float)(0*M_PI/180.0f), glm::vec3(0,0,1));
-				glm::mat4 scaleTriangle1 = glm::scale (glm::vec3(1.5f, 0.4f, 1.5f)); // glTranslatef
-				// rotate about vector (1,0,0)
-				glm::mat4 triangleTransform1 = translateTriangle1 * rotateTriangle1*scaleTriangle1;
-				Matrices.model *= triangleTransform1; 
-				MVP = VP * Matrices.model; // MVP = p * V * M
-
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-				draw3DObject(dcub5);
-			}
-				Matrices.model = glm::mat4(1.0f);
-
-glm::mat4 translateTriangle1 = glm::translate (glm::vec3(0.0f+(13+1)*6-30, 0.0f+posy[i][j], 0.0f+(8+1)*6-30)); // glTranslatef
-				glm::mat4 rotateTriangle1 = glm::rotate((float)(0*M_PI/180.0f), glm::vec3(0,0,1));
-				glm::mat4 scaleTriangle1 = glm::scale (glm::vec3(1.5f, 0.4f, 1.5f)); // glTranslate
-				// rotate about vector (1,0,0)
-				glm::mat4 triangleTransform1 = translateTriangle1 * rotateTriangle1*scaleTriangle1;
-				Matrices.model *= triangleTransform1; 
-				MVP = VP * Matrices.model; // MVP = p * V * M
 
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+	updateBoardMesh();
+	drawBoard(occlusionCulling);
 
-				draw3DObject(dcu);
-
-				}
-				else{
-				glm::mat4 translateTriangle = glm::translate (glm::vec3(0.0f+(j+1)*6-30, 0.0f+posy[i][j], 0.0f+(i+1)*6-30)); // glTranslatef
-				glm::mat4 rotateTriangle = glm::rotate((float)(0*M_PI/180.0f), glm::vec3(0,0,1));
-				glm::mat4 scaleTriangle = glm::scale (glm::vec3(1.5f, 0.4f, 1.5f)); // glTranslatef
-				// rotate about vector (1,0,0)
-				glm::mat4 triangleTransform = translateTriangle * rotateTriangle*scaleTriangle;
-				Matrices.model *= triangleTransform; 
-				MVP = VP * Matrices.model; // MVP = p * V * M
-
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-				draw3DObject(cuboid[i][j]);
-				}
-				
-	/*			Matrices.model = glm::mat4(1.0f);
-
-glm::mat4 translateTriangle1 = glm::translate (glm::vec3(0.0f+(j+1)*6-30, 0.0f+posy[i][j], 0.0f+(i+1)*6-30)); // glTranslatef
-				glm::mat4 rotateTriangle1 = glm::rotate((float)(0*M_PI/180.0f), glm::vec3(0,0,1));
-				glm::mat4 scaleTriangle1 = glm::scale (glm::vec3(1.5f, 0.4f, 1.5f)); // glTranslatef
-				// rotate about vector (1,0,0)
-				glm::mat4 triangleTransform1 = translateTriangle1 * rotateTriangle1*scaleTriangle1;
-				Matrices.model *= triangleTransform1; 
-				MVP = VP * Matrices.model; // MVP = p * V * M
-
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-				draw3DObject(rect[i][j]);
-*/
-
-			}
-		}
-	}
-	spo-=2;
-	if(spo<0)
-		spo=0;
-	int l1,r1,l2,r2;
-	l1=(-18+posx1+l3+l6+l7)/6 +4;
-	r1=(-6+posz1+r3+r6+r7+r8+r9)/6+4;
-	l2=(-18+posx2+l3+l6+l7)/6+4;
-	r2=(-6+posz2+r3+r6+r7+r8+r9)/6+4;
+	float drop=lastSpo+(spo-lastSpo)*tickAlpha;
+	float height1=lastPosy1+(posy1-lastPosy1)*tickAlpha;
+	float height2=lastPosy2+(posy2-lastPosy2)*tickAlpha;
+	int xs[2],zs[2];
+	blockCells(block,xs,zs);
 
 	Matrices.model = glm::mat4(1.0f);
-	glm::mat4 translateTriangle1 = glm::translate (glm::vec3(-18.0f+posx1+l3+l6+l7, 3.0f+posy1+spo, -6.0f+posz1+r3+r4+r6+r7+r8+r9)); // glTranslatef
+	glm::mat4 translateTriangle1 = glm::translate (glm::vec3(6.0f*xs[0]-24, 3.0f+height1+drop, 6.0f*zs[0]-24)); // glTranslatef
 
 	glm::mat4 rotateTriangle1 = glm::rotate((float)(0*M_PI/180.0f), glm::vec3(0,0,-3));
 
@@ -2391,14 +2209,11 @@ glm::mat4 translateTriangle1 = glm::translate (glm::vec3(0.0f+(j+1)*6-30, 0.0f+p
 	// rotate about vector (1,0,0)
 	glm::mat4 triangleTransform1 = translateTriangle1*rotateTriangle1 * scaleTriangle1;
 	Matrices.model *= triangleTransform1; 
-	MVP = VP * Matrices.model; // MVP = p * V * M
 
-	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-	draw3DObject(cub1);
 
+	drawObject(cub1, false);
 	Matrices.model = glm::mat4(1.0f);
-	glm::mat4 translateTriangle2 = glm::translate (glm::vec3(-18.0f+posx2+l3+l6+l7, 3.0f+posy2+spo, -6.0f+posz2+r3+r4+r6+r7+r8+r9)); // glTranslatef
+	glm::mat4 translateTriangle2 = glm::translate (glm::vec3(6.0f*xs[1]-24, 3.0f+height2+drop, 6.0f*zs[1]-24)); // glTranslatef
 
 	glm::mat4 rotateTriangle2 = glm::rotate((float)(0*M_PI/180.0f), glm::vec3(0,0,-3));
 
@@ -2406,115 +2221,10 @@ glm::mat4 translateTriangle1 = glm::translate (glm::vec3(0.0f+(j+1)*6-30, 0.0f+p
 	// rotate about vector (1,0,0)
 	glm::mat4 triangleTransform2 = translateTriangle2*rotateTriangle2 * scaleTriangle2;
 	Matrices.model *= triangleTransform2; 
-	MVP = VP * Matrices.model; // MVP = p * V * M
-
-	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-	draw3DObject(cub2);
-	if(a[r1][l1]==0 || a[r2][l2]==0 || r1<0 ||l1<0||r2<0||l2<0){
-	//Matrices.projection = glm::ortho(-100.0f,100.0f,-50.0f,50.0f,0.1f, 500.0f);
-		if(soff==0)
-		system("mpg123  -vC star.mp3 &");
-		double ctime=glfwGetTime();
-		if(ctime-utime>0.05){
-			utime=glfwGetTime();
-			posy1-=2;
-			posy2-=2;
-			disable=1;
-		}
-		if(posy1<-15){
-	view=0;
-		attempts++;
-
-			score-=10;
-			moves-=stmove;
-		init();
-		if(flag==1){
-			level1();
-		}
-		if(flag==2)
-			level2();
-		if(flag==3)
-			level3();
-		if(flag==4)
-			level4();
-		if(flag==5)
-			level6();
-		if(flag==6)
-			level7();
-		if(flag==7)
-			level8();
-		if(flag==8)
-			level9();
-		if(flag==9)
-			utime1=glfwGetTime();
-	}
 
-	}
-	
-	if(a[r1][l1]==4 && a[r2][l2]==4){
-		attempts=1;
-		if(sound==0){
-		if(soff==0)
 
-		system("mpg123  -vC finish.mp3 &");
-		sound=1;
-	}
-		double ctime=glfwGetTime();
-		if(ctime-utime>0.05){
-			utime=glfwGetTime();
-			posy1-=2;
-			posy2-=2;
-		}
-		if(posy1<-20){
-		init();
-		flag++;
-		score+=100;
-		if(flag==2)
-		level2();
-		if(flag==3){
-			level3();
-			l3=0;
-			r3=18;
-		}
-		if(flag==4){
-			level4();	
-		}
-		if(flag==5){
-			level6();
-			l6=-6;
-			r6=-18;
-		}
-		if(flag==6){
-			level7();
-			l7=6;
-			r7=6;
-		}
-		if(flag==7){
-			level8();
-			r8=6;
-		}
-		if(flag==8){
-			level9();
-			r9=-6;
-		}
-		if(flag==1)
-			level1();
-		}
-		if(flag==9)
-			utime1=glfwGetTime();
-	}
-	if(flag==4){
-		for(int i=1;i<3;i++)
-			for(int j=3;j<10;j++)
-				a[i][j]=6;
-			for(int i=6;i<10;i++)
-			for(int j=9;j<15;j++)
-				a[i][j]=6;
-		a[8][13]=5;
-	
+	drawObject(cub2, false);
 
-	}
 	Matrices.model = glm::mat4(1.0f);
 
 glm::mat4 translateTriangle11 = glm::translate (glm::vec3(75,-20 ,0 )); // glTranslatef
@@ -2523,12 +2233,9 @@ glm::mat4 translateTriangle11 = glm::translate (glm::vec3(75,-20 ,0 )); // glTra
 				// rotate about vector (1,0,0)
 				glm::mat4 triangleTransform11 = translateTriangle11* rotateTriangle11*scaleTriangle11;
 				Matrices.model *= triangleTransform11; 
-				//MVP = VP * Matrices.model; // MVP = p * V * M
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
 
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
 
-				draw3DObject(triangle);
+				drawObject(triangle, frame.Hud);
 
 				Matrices.model = glm::mat4(1.0f);
 
@@ -2538,12 +2245,9 @@ glm::mat4 translateTriangle12 = glm::translate (glm::vec3(85,-30 ,0 )); // glTra
 				// rotate about vector (1,0,0)
 				glm::mat4 triangleTransform12 = translateTriangle12* rotateTriangle12*scaleTriangle12;
 				Matrices.model *= triangleTransform12; 
-				//MVP = VP * Matrices.model; // MVP = p * V * M
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
 
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
 
-				draw3DObject(triangle1);
+				drawObject(triangle1, frame.Hud);
 
 				Matrices.model = glm::mat4(1.0f);
 
@@ -2553,12 +2257,9 @@ glm::mat4 translateTriangle13 = glm::translate (glm::vec3(75,-40 ,0 )); // glTra
 				// rotate about vector (1,0,0)
 				glm::mat4 triangleTransform13 = translateTriangle13* rotateTriangle13*scaleTriangle13;
 				Matrices.model *= triangleTransform13; 
-				//MVP = VP * Matrices.model; // MVP = p * V * M
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
 
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
 
-				draw3DObject(triangle2);
+				drawObject(triangle2, frame.Hud);
 
 				Matrices.model = glm::mat4(1.0f);
 
@@ -2568,200 +2269,52 @@ glm::mat4 translateTriangle14 = glm::translate (glm::vec3(65,-30 ,0 )); // glTra
 				// rotate about vector (1,0,0)
 				glm::mat4 triangleTransform14 = translateTriangle14* rotateTriangle14*scaleTriangle14;
 				Matrices.model *= triangleTransform14; 
-				//MVP = VP * Matrices.model; // MVP = p * V * M
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
-
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-				draw3DObject(triangle3);
-
-	if(flag==2){
-		Matrices.model = glm::mat4(1.0f);
-
-glm::mat4 translateTriangle1 = glm::translate (glm::vec3(0.0f+(2+1)*6-30, 0.0f, 0.0f+(4+1)*6-30)); // glTranslatef
-				glm::mat4 rotateTriangle1 = glm::rotate((float)(0*M_PI/180.0f), glm::vec3(0,0,1));
-				glm::mat4 scaleTriangle1 = glm::scale (glm::vec3(1.5f, 0.4f, 1.5f)); // glTranslatef
-				// rotate about vector (1,0,0)
-				glm::mat4 triangleTransform1 = translateTriangle1 * rotateTriangle1*scaleTriangle1;
-				Matrices.model *= triangleTransform1; 
-				MVP = VP * Matrices.model; // MVP = p * V * M
-
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-				draw3DObject(dcub2);
-
-				Matrices.model = glm::mat4(1.0f);
-
-glm::mat4 translateTriangle2 = glm::translate (glm::vec3(0.0f+(8+1)*6-30, 0.0f, 0.0f+(3+1)*6-30)); // glTranslatef
-				glm::mat4 rotateTriangle2 = glm::rotate((float)(0*M_PI/180.0f), glm::vec3(0,0,1));
-				glm::mat4 scaleTriangle2 = glm::scale (glm::vec3(1.5f, 0.4f, 1.5f)); // glTranslatef
-				// rotate about vector (1,0,0)
-				glm::mat4 triangleTransform2 = translateTriangle2 * rotateTriangle2*scaleTriangle2;
-				Matrices.model *= triangleTransform2; 
-				MVP = VP * Matrices.model; // MVP = p * V * M
-
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
 
-				draw3DObject(dcub3);
 
-		if(a[r1][l1]==2 || a[r2][l2]==2){
-		if(a[6][4]==0 && l2tog==0){
-		if(soff==0)
-
-		system("mpg123  -vC star.mp3 &");
-
-			a[6][4]=1;
-			a[6][5]=1;
-			l2f=1;
-		}
-		else if(a[6][4]==1 && l2tog==1){
-		if(soff==0)
-
-		system("mpg123  -vC star.mp3 &");
-
-			a[6][4]=0;
-			a[6][5]=0;
-			l2f=0;
-		}
-		}
-		else if(l2f==1){
-			l2tog=1;
-		}
-		else if(l2f==0){
-			l2tog=0;
-		}
-		if(a[r1][l1]==3 && a[r2][l2]==3){
-		if(a[6][10]==0 && l2togl==0){
-		if(soff==0)
-
-		system("mpg123  -vC star.mp3 &");
-
-			a[6][10]=1;
-			a[6][11]=1;
-			l2r=1;
-		}
-		else if(a[6][10]==1  && l2togl==1){
-		if(soff==0)
+				drawObject(triangle3, frame.Hud);
 
-		system("mpg123  -vC star.mp3 &");
 
-			a[6][10]=0;
-			a[6][11]=0;
-			l2r=0;
-		}
-		}
-		else if(l2r==1){
-			l2togl=1;
+	/* Switch and split tiles get a coloured cap, wherever the level puts them */
+	for(size_t k=0;k<board.switches.size()+board.splits.size();k++){
+		int mx,mz;
+		VAO *marker;
+		if(k<board.switches.size()){
+			mx=board.switches[k].x;
+			mz=board.switches[k].z;
+			if(board.planes[PLANE_HEAVY_SWITCH].test(mz*board.cols+mx))
+				marker=dcub;
+			else
+				marker=(k%2==0)?dcub2:dcub3;
 		}
-		else if(l2r==0){
-			l2togl=0;
+		else{
+			mx=board.splits[k-board.switches.size()].x;
+			mz=board.splits[k-board.switches.size()].z;
+			marker=dcub1;
 		}
-	}
-	if(flag==4){
-		
-		
-		 if((a[r1][l1]==6 && a[r2][l2]==6 && posy1!=posy2)){
-		a[r1][l1]=0;
-	}
-
-	}
-if(flag==6){
-	
-Matrices.model = glm::mat4(1.0f);
-
-glm::mat4 translateTriangle1 = glm::translate (glm::vec3(0.0f+(9+1)*6-30, 0.0f, 0.0f+(5+1)*6-30)); // glTranslatef
-				glm::mat4 rotateTriangle1 = glm::rotate((float)(0*M_PI/180.0f), glm::vec3(0,0,1));
-				glm::mat4 scaleTriangle1 = glm::scale (glm::vec3(1.5f, 0.4f, 1.5f)); // glTranslatef
-				// rotate about vector (1,0,0)
-				glm::mat4 triangleTransform1 = translateTriangle1 * rotateTriangle1*scaleTriangle1;
-				Matrices.model *= triangleTransform1; 
-				MVP = VP * Matrices.model; // MVP = p * V * M
-
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-				draw3DObject(dcub);
-				//printf("%d %d\n",a[r1+1][l1+1],a[r2+1][l2+1]);
-		if(a[r1][l1]==2 && a[r2][l2]==2){
-			a[7][3]=1;
-	}
-}
-	if(flag==7){
-		Matrices.model = glm::mat4(1.0f);
-
-glm::mat4 translateTriangle1 = glm::translate (glm::vec3(0.0f+(4+1)*6-30, 0.0f, 0.0f+(5+1)*6-30)); // glTranslatef
-				glm::mat4 rotateTriangle1 = glm::rotate((float)(0*M_PI/180.0f), glm::vec3(0,0,1));
-				glm::mat4 scaleTriangle1 = glm::scale (glm::vec3(1.5f, 0.4f, 1.5f)); // glTranslatef
-				// rotate about vector (1,0,0)
-				glm::mat4 triangleTransform1 = translateTriangle1 * rotateTriangle1*scaleTriangle1;
-				Matrices.model *= triangleTransform1; 
-				MVP = VP * Matrices.model; // MVP = p * V * M
-
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-				draw3DObject(dcub1);
-				if(a[r1][l1]==7 && a[r2][l2]==7){
-			posx1+=36;
-			posx2+=36;
-			posy1-=6;
-			posz1+=18;
-			posz2-=18;
-			l8f=1;
-	}
-	if(r1==5 && l1==11 && r2==5 && l2==12)
-		l8f=0;
-	else if(r2==5 && l2==12)
-		l8f=2;
-	}
-
-	if(flag==8){
 		Matrices.model = glm::mat4(1.0f);
-
-glm::mat4 translateTriangle1 = glm::translate (glm::vec3(0.0f+(13+1)*6-30, 0.0f, 0.0f+(4+1)*6-30)); // glTranslatef
-				glm::mat4 rotateTriangle1 = glm::rotate((float)(0*M_PI/180.0f), glm::vec3(0,0,1));
-				glm::mat4 scaleTriangle1 = glm::scale (glm::vec3(1.5f, 0.4f, 1.5f)); // glTranslatef
-				// rotate about vector (1,0,0)
-				glm::mat4 triangleTransform1 = translateTriangle1 * rotateTriangle1*scaleTriangle1;
-				Matrices.model *= triangleTransform1; 
-				MVP = VP * Matrices.model; // MVP = p * V * M
-
-				glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-				draw3DObject(dcub1);
-				if(a[r1][l1]==7 && a[r2][l2]==7){
-			posx1-=6;
-			posx2-=66;
-			posy2-=6;
-			//posz1+=18;
-			//posz2-=18;
-			l8f=1;
-	}
-	if(r1==5 && l1==7 && r2==4 && l2==7)
-		l8f=0;
-	else if(r2==4 && l2==7)
-		l8f=2;
+		glm::mat4 translateMarker = glm::translate (glm::vec3(0.0f+(mx+1)*6-30, 0.0f, 0.0f+(mz+1)*6-30));
+		glm::mat4 scaleMarker = glm::scale (glm::vec3(1.5f, 0.4f, 1.5f));
+		Matrices.model *= translateMarker*scaleMarker;
+		drawObject(marker, false, LAYER_OVERLAY);
 	}
 
 float fontScaleValue = 10 ;
 static int fontScale=280;
 	glm::vec3 fontColor = getRGBfromHue (fontScale);
 
-	glUseProgram(fontProgramID);
 
 
 	char level_str[30];
 	sprintf(level_str,"MOVES: %d",moves);
-	Matrices.view = glm::lookAt(glm::vec3(0,0,3), glm::vec3(0,0,0), glm::vec3(0,1,0)); // Fixed camera for 2D (ortho) in XY plane
+	useHudCamera();
 
 	// Transform the text
 	Matrices.model = glm::mat4(1.0f);
 	glm::mat4 translateText = glm::translate(glm::vec3(50,35,0));
 	glm::mat4 scaleText = glm::scale(glm::vec3(fontScaleValue,fontScaleValue,fontScaleValue));
 	Matrices.model *= (translateText * scaleText);
-	MVP = Matrices.projection * Matrices.view * Matrices.model;
-	// send font's MVP and font color to fond shaders
-	glUniformMatrix4fv(GL3Font.fontMatrixID, 1, GL_FALSE, &MVP[0][0]);
-	glUniform3fv(GL3Font.fontColorID, 1, &fontColor[0]);
-	GL3Font.font->Render(level_str);
+	// send font's model matrix and font color to fond shaders
+	drawText(level_str, fontColor, frame.Hud);
 
 	//display_string(50,35,level_str,fontScaleValue);
 
@@ -2769,6 +2322,7 @@ static int fontScale=280;
 	// Pop matrix to undo transformations till last push matrix instead of recomputing model matrix
 	// glPopMatrix ();
 }
+	submitDrawList();
 	// Increment angles
 	float increments = 1;
 
@@ -2802,7 +2356,7 @@ GLFWwindow* initGLFW (int width, int height)
 
 	glfwMakeContextCurrent(window);
 	gladLoadGLLoader((GLADloadproc) glfwGetProcAddress);
-	glfwSwapInterval( 1 );
+	glfwSwapInterval( swapInterval );
 
 	/* --- register callbacks with GLFW --- */
 
@@ -2838,8 +2392,15 @@ void initGL (GLFWwindow* window, int width, int height)
 	createCircle();
 	// Create and compile our GLSL program from the shaders
 	programID = LoadShaders( "Sample_GL.vert", "Sample_GL.frag" );
-	// Get a handle for our "MVP" uniform
-	Matrices.MatrixID = glGetUniformLocation(programID, "MVP");
+	// Get a handle for our "M" uniform
+	Matrices.MatrixID = glGetUniformLocation(programID, "M");
+	bindFrameBlock(programID);
+	createFrameBlock();
+
+	boardMesh.ProgramID = LoadShaders( "Tile_GL.vert", "Sample_GL.frag" );
+	bindFrameBlock(boardMesh.ProgramID);
+	glUseProgram(boardMesh.ProgramID);
+	glUniform3fv(glGetUniformLocation(boardMesh.ProgramID, "palette"), TILE_PALETTES*36, tilePalette);
 
 
 	reshapeWindow (window, width, height);
@@ -2853,30 +2414,14 @@ void initGL (GLFWwindow* window, int width, int height)
 
 
 
-const char* fontfile = "monaco.ttf";
-	GL3Font.font = new FTExtrudeFont(fontfile); // 3D extrude style rendering
-
-	if(GL3Font.font->Error())
-	{
-		cout << "Error: Could not load font `" << fontfile << "'" << endl;
-		glfwTerminate();
-		exit(EXIT_FAILURE);
-	}
+	createTextBatch("monaco.ttf");
 
 	// Create and compile our GLSL program from the font shaders
 	fontProgramID = LoadShaders( "fontrender.vert", "fontrender.frag" );
-	GLint fontVertexCoordAttrib, fontVertexNormalAttrib, fontVertexOffsetUniform;
-	fontVertexCoordAttrib = glGetAttribLocation(fontProgramID, "vertexPosition");
-	fontVertexNormalAttrib = glGetAttribLocation(fontProgramID, "vertexNormal");
-	fontVertexOffsetUniform = glGetUniformLocation(fontProgramID, "pen");
-	GL3Font.fontMatrixID = glGetUniformLocation(fontProgramID, "MVP");
-	GL3Font.fontColorID = glGetUniformLocation(fontProgramID, "fontColor");
-
-	GL3Font.font->ShaderLocations(fontVertexCoordAttrib, fontVertexNormalAttrib, fontVertexOffsetUniform);
-	GL3Font.font->FaceSize(1);
-	GL3Font.font->Depth(0);
-	GL3Font.font->Outset(0, 0);
-GL3Font.font->CharMap(ft_encoding_unicode);
+	bindFrameBlock(fontProgramID);
+	glUseProgram(fontProgramID);
+	glUniform1i(glGetUniformLocation(fontProgramID, "atlas"), 0);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 
 	cout << "VENDOR: " << glGetString(GL_VENDOR) << endl;
@@ -2887,6 +2432,43 @@ GL3Font.font->CharMap(ft_encoding_unicode);
 
 int main (int argc, char** argv)
 {
+	int command = runCommand(argc, argv);
+	if (command >= 0)
+		return command;
+
+	std::string error;
+	if (!stagePack.open(DEFAULT_BINARY_PACK, error)) {
+		cout << "Error: " << error << " (run make to build it)" << endl;
+		return 1;
+	}
+	if (stagePack.count() == 0) {
+		cout << "Error: " << DEFAULT_BINARY_PACK << " has no levels" << endl;
+		return 1;
+	}
+	lastStage = stagePack.count();
+
+	// --audio device|null|wav FILE, for machines without a sound card
+	int audio = AUDIO_DEVICE;
+	const char* wavPath = NULL;
+	for (int i=1; i+1<argc; i++)
+		if (strcmp(argv[i], "--audio") == 0) {
+			if (strcmp(argv[i+1], "null") == 0)
+				audio = AUDIO_NULL;
+			else if (strcmp(argv[i+1], "wav") == 0 && i+2 < argc) {
+				audio = AUDIO_WAV;
+				wavPath = argv[i+2];
+			}
+		}
+	if (!startAudio(audio, wavPath, error))
+		cout << "Sound off: " << error << endl;
+	// --uncapped draws as fast as it can; the game runs at TICK_RATE either way.
+	// --stats reports what each frame cost, for benchmarks
+	for (int i=1; i<argc; i++)
+		if (strcmp(argv[i], "--uncapped") == 0)
+			swapInterval = 0;
+		else if (strcmp(argv[i], "--stats") == 0)
+			showStats = true;
+
 	int width = 1500;
 	int height = 800;
 
@@ -2895,29 +2477,61 @@ int main (int argc, char** argv)
 	initGL (window, width, height);
 
 	double last_update_time = glfwGetTime();
+	double last_frame_time = last_update_time;
+	double behind = 0;	// time not yet ticked
+	int ticks = 0;
 
 	/* Draw in loop */
 	while (!glfwWindowShouldClose(window)) {
 
+		// Poll for Keyboard and mouse events
+		glfwPollEvents();
+		if(heli==1  && lmouse1==1)
+			drag(window);
+
+		// Catch the game up with the clock; after a long stall, give up on the lost time
+		double now = glfwGetTime();
+		behind += min(now - last_frame_time, 0.25);
+		last_frame_time = now;
+		while (behind >= TICK) {
+			processInput(window);
+			simulate();
+			gameTime += TICK;
+			behind -= TICK;
+			ticks++;
+		}
+		tickAlpha = behind / TICK;
+		flushSounds(gameTime);
+
 		// OpenGL Draw commands
 		draw();
 
 		// Swap Frame Buffer in double buffering
 		glfwSwapBuffers(window);
  display_string(window);
-
-		// Poll for Keyboard and mouse events
-		glfwPollEvents();
-		if(heli==1  && lmouse1==1)
-			drag(window);
 		// Control based on time (Time based transformation like 5 degrees rotation every 0.5s)
 		current_time = glfwGetTime(); // Time in seconds
 		if ((current_time - last_update_time) >= 0.5) { // atleast 0.5s elapsed since last frame
 			// do something every 0.5 seconds ..
+			if(showStats)
+				cout << "GL state changes: " << renderState.Issued << " sent, " << renderState.Skipped << " skipped" << endl;
+			if(showStats)
+				cout << "Last frame: " << lastFrameStats.Draws << " draws, " << lastFrameStats.Tiles << " tiles drawn, "
+					<< lastFrameStats.ChunksCulled << " of " << lastFrameStats.Chunks << " chunks culled ("
+					<< lastFrameStats.TilesCulled << " tiles), " << lastFrameStats.TilesOccluded << " tiles occluded, "
+					<< lastFrameStats.ChunksBaked << " chunks baked" << endl;
+			if(showStats)
+				cout << "Input: " << inputStats.Events << " events, " << inputStats.MaxLatency*1000 << " ms worst latency, "
+					<< inputQueue.dropped << " dropped; " << ticks << " ticks" << endl;
+			renderState.Issued = renderState.Skipped = 0;
+			ticks = 0;
+			inputStats.Events = 0;
+			inputStats.MaxLatency = 0;
 			last_update_time = current_time;
 		}
 	}
 
+	stopAudio();
 	glfwTerminate();
 	//    exit(EXIT_SUCCESS);
 }
@@ -0,0 +1,31 @@
+#version 330 core
+
+#define TILE_PALETTES 4
+
+#define DROP_HEIGHT 60.0	// tiles rise from this far below the board
+
+// input data : the shared cube, and one instance per visible tile
+layout (location = 0) in vec3 vertexPosition;
+layout (location = 2) in vec4 tileInstance;	// x, z, palette, time the drop-in starts
+layout (location = 3) in float dropSpeed;	// units per second
+
+const vec3 tileScale = vec3(1.5, 0.4, 1.5);	// the shared cube is 4 units a side
+
+// laid out as in Sample_GL.vert
+layout (std140) uniform Frame {
+    mat4 VP;
+    vec4 eye;
+    float time;
+};
+
+uniform vec3 palette[TILE_PALETTES*36];	// per cube vertex, one set per palette
+
+// output data : used by fragment shader
+out vec3 fragColor;
+
+void main ()
+{
+    float height = min(dropSpeed*(time - tileInstance.w) - DROP_HEIGHT, 0.0);
+    fragColor = palette[int(tileInstance.z)*36 + gl_VertexID];
+    gl_Position = VP * vec4(vertexPosition*tileScale + vec3(tileInstance.x, height, tileInstance.y), 1);
+}
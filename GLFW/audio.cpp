@@ -0,0 +1,289 @@
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <thread>
+#ifdef __linux__
+#include <alsa/asoundlib.h>
+#endif
+#include "audio.h"
+#include "pcmcache.h"
+
+#define AUDIO_QUEUE 64		// requests the game can make between two periods
+
+static const char *clipFiles[SOUND_COUNT] = { "sound1.mp3", "star.mp3", "finish.mp3" };
+
+/* How often each sound may start, and how many copies may overlap */
+struct SoundRule {
+	int voices;
+	double cooldown;	// seconds between two starts
+};
+
+static const SoundRule soundRules[SOUND_COUNT] = {
+	{ 4, 0.05 },	// SOUND_MOVE: quick moves may overlap a little
+	{ 1, 0.25 },	// SOUND_SWITCH: asked for on every frame of a fall
+	{ 1, 1.0 },	// SOUND_FINISH
+};
+
+struct Voice {
+	const PcmClip *clip;	// NULL when free
+	size_t at;		// next sample
+};
+
+/* Game thread side of playSound() */
+static struct Triggers {
+	unsigned pending;		// bit per sound asked for since the last flush
+	double started[SOUND_COUNT];	// when each was last sent to the mixer
+} triggers;
+
+/* The game thread only writes head, the mixer only writes tail */
+static struct Mixer {
+	PcmCache clips;		// interleaved AUDIO_CHANNELS at AUDIO_RATE
+	Voice voices[AUDIO_VOICES];
+	uint8_t queue[AUDIO_QUEUE];	// SOUND_* to start
+	std::atomic<unsigned> head, tail;
+	std::atomic<bool> running;
+	int backend;
+	std::thread thread;		// AUDIO_DEVICE only
+	FILE *wav;			// AUDIO_WAV only
+	uint32_t wavFrames;
+	double clockStart;		// first flushSounds() time, <0 before it
+	uint64_t mixedFrames;		// since clockStart
+#ifdef __linux__
+	snd_pcm_t *pcm;
+#endif
+} mixer;
+
+/* Start whatever the game asked for, then mix one period of the
+   playing voices */
+static void mixPeriod (int16_t *out)
+{
+	unsigned head = mixer.head.load(std::memory_order_acquire);
+	for (unsigned t = mixer.tail.load(std::memory_order_relaxed); t != head; t++) {
+		int sound = mixer.queue[t % AUDIO_QUEUE];
+		const PcmClip &clip = mixer.clips.clip(sound);
+		int v = -1, playing = 0;
+		for (int k = 0; k < AUDIO_VOICES; k++) {
+			if (mixer.voices[k].clip == &clip)
+				playing++;
+			else if (!mixer.voices[k].clip && v < 0)
+				v = k;
+		}
+		if (v < 0 || playing >= soundRules[sound].voices || clip.count == 0)
+			continue;	// at its limit, or nothing to play
+		mixer.voices[v].clip = &clip;
+		mixer.voices[v].at = 0;
+	}
+	mixer.tail.store(head, std::memory_order_release);
+
+	int32_t sum[AUDIO_PERIOD*AUDIO_CHANNELS];
+	memset(sum, 0, sizeof sum);
+	for (int v = 0; v < AUDIO_VOICES; v++) {
+		Voice &voice = mixer.voices[v];
+		if (!voice.clip)
+			continue;
+		size_t n = voice.clip->count - voice.at;
+		if (n > AUDIO_PERIOD*AUDIO_CHANNELS)
+			n = AUDIO_PERIOD*AUDIO_CHANNELS;
+		const int16_t *in = voice.clip->samples + voice.at;
+		for (size_t i = 0; i < n; i++)
+			sum[i] += in[i];
+		voice.at += n;
+		if (voice.at >= voice.clip->count)
+			voice.clip = NULL;
+	}
+	for (int i = 0; i < AUDIO_PERIOD*AUDIO_CHANNELS; i++)
+		out[i] = sum[i] < -32768 ? -32768 : sum[i] > 32767 ? 32767 : sum[i];
+}
+
+#ifdef __linux__
+/* A short device buffer keeps a new sound about one period away */
+static bool openDevice (std::string &error)
+{
+	int err = snd_pcm_open(&mixer.pcm, "default", SND_PCM_STREAM_PLAYBACK, 0);
+	if (err < 0) {
+		error = std::string("cannot open audio device: ") + snd_strerror(err);
+		return false;
+	}
+	err = snd_pcm_set_params(mixer.pcm, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED,
+		AUDIO_CHANNELS, AUDIO_RATE, 1, 2*AUDIO_PERIOD*1000000LL/AUDIO_RATE);
+	if (err < 0) {
+		snd_pcm_close(mixer.pcm);
+		error = std::string("cannot set up audio device: ") + snd_strerror(err);
+		return false;
+	}
+	return true;
+}
+
+static void closeDevice ()
+{
+	snd_pcm_drain(mixer.pcm);
+	snd_pcm_close(mixer.pcm);
+}
+
+/* Blocks until the device has room, which paces the mixer */
+static void writeDevice (const int16_t *samples)
+{
+	snd_pcm_sframes_t left = AUDIO_PERIOD;
+	while (left > 0) {
+		snd_pcm_sframes_t n = snd_pcm_writei(mixer.pcm, samples, left);
+		if (n < 0) {
+			if (snd_pcm_recover(mixer.pcm, n, 1) < 0)
+				return;
+			continue;
+		}
+		samples += n*AUDIO_CHANNELS;
+		left -= n;
+	}
+}
+#else
+static bool openDevice (std::string &error)
+{
+	error = "no audio device support on this platform";
+	return false;
+}
+
+static void closeDevice () {}
+static void writeDevice (const int16_t *) {}
+#endif
+
+/* Canonical 44-byte PCM header; the sizes are filled in by closeWav() */
+static void writeWavHeader (FILE *f, uint32_t frames)
+{
+	uint32_t data = frames*AUDIO_CHANNELS*sizeof(int16_t);
+	uint32_t fields[11] = {
+		0x46464952, 36 + data, 0x45564157,	// "RIFF", size, "WAVE"
+		0x20746d66, 16, 1 | AUDIO_CHANNELS << 16,	// "fmt ", size, PCM and channels
+		AUDIO_RATE, AUDIO_RATE*AUDIO_CHANNELS*sizeof(int16_t),
+		AUDIO_CHANNELS*sizeof(int16_t) | 16 << 16,	// block align, bits per sample
+		0x61746164, data			// "data", size
+	};
+	fwrite(fields, sizeof fields, 1, f);
+}
+
+static bool openWav (const char *path, std::string &error)
+{
+	if (!path || !(mixer.wav = fopen(path, "wb"))) {
+		error = std::string("cannot write ") + (path ? path : "a WAV file without a name");
+		return false;
+	}
+	mixer.wavFrames = 0;
+	writeWavHeader(mixer.wav, 0);
+	return true;
+}
+
+static void closeWav ()
+{
+	rewind(mixer.wav);
+	writeWavHeader(mixer.wav, mixer.wavFrames);
+	fclose(mixer.wav);
+}
+
+static void writePeriod (const int16_t *samples)
+{
+	if (mixer.backend == AUDIO_DEVICE)
+		writeDevice(samples);
+	else if (mixer.backend == AUDIO_WAV) {
+		fwrite(samples, sizeof(int16_t), AUDIO_PERIOD*AUDIO_CHANNELS, mixer.wav);
+		mixer.wavFrames += AUDIO_PERIOD;
+	}
+	mixer.mixedFrames += AUDIO_PERIOD;
+}
+
+/* Without a device thread: mix every period the game clock has passed */
+static void advanceMixer (double now)
+{
+	if (mixer.clockStart < 0)
+		mixer.clockStart = now;
+	uint64_t due = (uint64_t)((now - mixer.clockStart)*AUDIO_RATE);
+	int16_t period[AUDIO_PERIOD*AUDIO_CHANNELS];
+	while (mixer.mixedFrames + AUDIO_PERIOD <= due) {
+		mixPeriod(period);
+		writePeriod(period);
+	}
+}
+
+static bool voicesPlaying ()
+{
+	for (int v = 0; v < AUDIO_VOICES; v++)
+		if (mixer.voices[v].clip)
+			return true;
+	return false;
+}
+
+static void runMixer ()
+{
+	int16_t period[AUDIO_PERIOD*AUDIO_CHANNELS];
+	while (mixer.running.load(std::memory_order_relaxed)) {
+		mixPeriod(period);
+		writePeriod(period);
+	}
+	closeDevice();
+}
+
+bool startAudio (int backend, const char *wavPath, std::string &error)
+{
+	if (!mixer.clips.load(DEFAULT_PCM_CACHE, clipFiles, SOUND_COUNT, AUDIO_RATE, AUDIO_CHANNELS, error))
+		return false;
+	if ((backend == AUDIO_DEVICE && !openDevice(error)) || (backend == AUDIO_WAV && !openWav(wavPath, error)))
+		return false;
+	mixer.backend = backend;
+	mixer.clockStart = -1;
+	mixer.mixedFrames = 0;
+	mixer.head = mixer.tail = 0;
+	memset(mixer.voices, 0, sizeof mixer.voices);
+	triggers.pending = 0;
+	for (int s = 0; s < SOUND_COUNT; s++)
+		triggers.started[s] = -1e9;
+	mixer.running = true;
+	if (backend == AUDIO_DEVICE)
+		mixer.thread = std::thread(runMixer);
+	return true;
+}
+
+void stopAudio ()
+{
+	if (!mixer.running)
+		return;
+	mixer.running = false;
+	if (mixer.backend == AUDIO_DEVICE) {
+		mixer.thread.join();
+		return;
+	}
+	int16_t period[AUDIO_PERIOD*AUDIO_CHANNELS];
+	if (mixer.backend == AUDIO_WAV) {
+		while (mixer.head != mixer.tail || voicesPlaying()) {
+			mixPeriod(period);
+			writePeriod(period);
+		}
+		closeWav();
+	}
+}
+
+void playSound (int sound)
+{
+	triggers.pending |= 1u << sound;
+}
+
+void flushSounds (double now)
+{
+	unsigned pending = triggers.pending;
+	triggers.pending = 0;
+	if (!mixer.running.load(std::memory_order_relaxed))
+		return;
+	if (mixer.backend != AUDIO_DEVICE)
+		advanceMixer(now);
+	if (!pending)
+		return;
+	unsigned head = mixer.head.load(std::memory_order_relaxed);
+	unsigned tail = mixer.tail.load(std::memory_order_acquire);
+	for (int s = 0; s < SOUND_COUNT; s++) {
+		if (!(pending & 1u << s) || now - triggers.started[s] < soundRules[s].cooldown)
+			continue;
+		if (head - tail >= AUDIO_QUEUE)
+			break;		// the mixer has stalled; drop the rest
+		mixer.queue[head++ % AUDIO_QUEUE] = s;
+		triggers.started[s] = now;
+	}
+	mixer.head.store(head, std::memory_order_release);
+}
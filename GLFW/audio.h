@@ -0,0 +1,53 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <string>
+
+/*
+ * Sound effects, mixed in-process. The clips are decoded to PCM once,
+ * a mixer thread plays them on the audio device, and the game thread
+ * asks for a sound through a lock-free queue, so playing one never
+ * blocks a frame or an input callback.
+ *
+ * Without a device the mixer runs on the game thread instead, inside
+ * flushSounds(), and keeps pace with the game clock it is given: the
+ * null backend throws the mix away, the WAV backend records it. Given
+ * the same flushSounds() times a WAV recording is the same every run.
+ */
+
+enum Sound {
+	SOUND_MOVE,		// sound1.mp3, the block rolls
+	SOUND_SWITCH,		// star.mp3, a switch fires or the block falls
+	SOUND_FINISH,		// finish.mp3, the goal is reached
+	SOUND_COUNT
+};
+
+#define AUDIO_RATE 44100
+#define AUDIO_CHANNELS 2
+#define AUDIO_PERIOD 256	// frames mixed at a time, about 6 ms
+#define AUDIO_VOICES 16		// sounds that can play at once
+
+enum AudioBackend {
+	AUDIO_DEVICE,
+	AUDIO_NULL,
+	AUDIO_WAV
+};
+
+/* Decodes the clips, opens the backend and starts the mixer; wavPath
+   is only read for AUDIO_WAV. On failure the game runs silently and
+   playSound() does nothing. */
+bool startAudio (int backend, const char *wavPath, std::string &error);
+
+/* A WAV recording is finished first: playing sounds run to their end */
+void stopAudio ();
+
+/* Game thread only. Asking for a sound just marks it; the marks are
+   sent to the mixer by flushSounds(), once a frame, so a sound asked
+   for many times in a frame plays once. */
+void playSound (int sound);
+
+/* Sends the sounds marked since the last call, skipping any still in
+   its cooldown. now is the game clock in seconds. */
+void flushSounds (double now);
+
+#endif
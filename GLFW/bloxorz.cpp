@@ -0,0 +1,484 @@
+#include <cstddef>
+#include "bloxorz.h"
+
+/**************
+ * Level setup *
+ **************/
+int addSwitch (Level &level, int x, int z, int mode)
+{
+	SwitchBinding sw;
+	sw.x = x;
+	sw.z = z;
+	sw.mode = mode;
+	sw.targets.reset(level.rows*level.cols);
+	level.switches.push_back(sw);
+	return level.switches.size() - 1;
+}
+
+void addSwitchTarget (Level &level, int index, int x, int z)
+{
+	level.switches[index].targets.set(z*level.cols + x);
+	level.bridges.set(z*level.cols + x);
+}
+
+void addSplit (Level &level, int x, int z, int x1, int z1, int x2, int z2, int hx, int hz, int mx1, int mz1, int mx2, int mz2)
+{
+	SplitBinding sp = { x, z, x1, z1, x2, z2, hx, hz, mx1, mz1, mx2, mz2 };
+	level.splits.push_back(sp);
+}
+
+void resetLevel (Level &level, int cols, int rows)
+{
+	level.rows = rows;
+	level.cols = cols;
+	for (int p = 0; p < PLANE_COUNT; p++)
+		level.planes[p].reset(rows*cols);
+	level.bridges.reset(rows*cols);
+	level.switches.clear();
+	level.splits.clear();
+	level.transitions.clear();
+	level.startX = 0;
+	level.startZ = 0;
+	level.cameraX = 0;
+	level.cameraZ = 0;
+}
+
+void setTile (Level &level, int x, int z, int tile)
+{
+	int cell = z*level.cols + x;
+	for (int p = 0; p < PLANE_COUNT; p++)
+		level.planes[p].clear(cell);
+	if (tile == TILE_EMPTY)
+		return;
+	level.planes[PLANE_FLOOR].set(cell);
+	switch (tile) {
+		case TILE_SOFT_SWITCH:  level.planes[PLANE_SOFT_SWITCH].set(cell); break;
+		case TILE_HEAVY_SWITCH: level.planes[PLANE_HEAVY_SWITCH].set(cell); break;
+		case TILE_GOAL:         level.planes[PLANE_GOAL].set(cell); break;
+		case TILE_FRAGILE:      level.planes[PLANE_FRAGILE].set(cell); break;
+		case TILE_SPLIT:        level.planes[PLANE_SPLIT].set(cell); break;
+		case TILE_LIGHT:        level.planes[PLANE_LIGHT].set(cell); break;
+	}
+}
+
+/*********
+ * Rules *
+ *********/
+BlockState startState (const Level &level)
+{
+	BlockState s;
+	s.x = s.x2 = level.startX;
+	s.z = s.z2 = level.startZ;
+	s.orient = ORIENT_STANDING;
+	s.active = 0;
+	s.switches = 0;
+	s.status = STATUS_PLAYING;
+	return s;
+}
+
+/* Cell index of (x, z), or -1 off the board */
+static inline int cellOf (const Level &level, int x, int z)
+{
+	if (x < 0 || z < 0 || x >= level.cols || z >= level.rows)
+		return -1;
+	return z*level.cols + x;
+}
+
+/* Floor plane with the switch flips applied */
+static inline bool solid (const Level &level, unsigned switches, int cell)
+{
+	if (cell < 0)
+		return false;
+	bool on = level.planes[PLANE_FLOOR].test(cell);
+	if (switches && level.bridges.test(cell))
+		for (size_t i = 0; i < level.switches.size(); i++)
+			if ((switches >> i) & 1 && level.switches[i].targets.test(cell))
+				on = !on;
+	return on;
+}
+
+int brokenCell (const Level &level, const BlockState &s)
+{
+	if (s.status != STATUS_FELL || s.orient != ORIENT_STANDING)
+		return -1;
+	int cell = cellOf(level, s.x, s.z);
+	if (!solid(level, s.switches, cell) || !level.planes[PLANE_FRAGILE].test(cell))
+		return -1;
+	return cell;
+}
+
+int tileAt (const Level &level, const BlockState &s, int x, int z)
+{
+	int cell = cellOf(level, x, z);
+	if (!solid(level, s.switches, cell) || cell == brokenCell(level, s))
+		return TILE_EMPTY;
+	if (level.planes[PLANE_SOFT_SWITCH].test(cell))
+		return TILE_SOFT_SWITCH;
+	if (level.planes[PLANE_HEAVY_SWITCH].test(cell))
+		return TILE_HEAVY_SWITCH;
+	if (level.planes[PLANE_GOAL].test(cell))
+		return TILE_GOAL;
+	if (level.planes[PLANE_FRAGILE].test(cell))
+		return TILE_FRAGILE;
+	if (level.planes[PLANE_SPLIT].test(cell))
+		return TILE_SPLIT;
+	if (level.planes[PLANE_LIGHT].test(cell))
+		return TILE_LIGHT;
+	return TILE_FLOOR;
+}
+
+int blockCells (const BlockState &s, int xs[2], int zs[2])
+{
+	xs[0] = xs[1] = s.x;
+	zs[0] = zs[1] = s.z;
+	switch (s.orient) {
+		case ORIENT_STANDING:
+			return 1;
+		case ORIENT_LYING_X:
+			xs[1] = s.x + 1;
+			break;
+		case ORIENT_LYING_Z:
+			zs[1] = s.z + 1;
+			break;
+		case ORIENT_SPLIT:
+			xs[1] = s.x2;
+			zs[1] = s.z2;
+			break;
+	}
+	return 2;
+}
+
+static void roll (BlockState &s, int move)
+{
+	int dx = 0, dz = 0;
+	switch (move) {
+		case MOVE_UP:    dz = -1; break;
+		case MOVE_DOWN:  dz = 1;  break;
+		case MOVE_LEFT:  dx = -1; break;
+		case MOVE_RIGHT: dx = 1;  break;
+	}
+
+	switch (s.orient) {
+		case ORIENT_STANDING:
+			if (dx) {
+				s.orient = ORIENT_LYING_X;
+				s.x += dx > 0 ? 1 : -2;
+			}
+			else {
+				s.orient = ORIENT_LYING_Z;
+				s.z += dz > 0 ? 1 : -2;
+			}
+			break;
+		case ORIENT_LYING_X:
+			if (dx) {
+				s.orient = ORIENT_STANDING;
+				s.x += dx > 0 ? 2 : -1;
+			}
+			else
+				s.z += dz;
+			break;
+		case ORIENT_LYING_Z:
+			if (dz) {
+				s.orient = ORIENT_STANDING;
+				s.z += dz > 0 ? 2 : -1;
+			}
+			else
+				s.x += dx;
+			break;
+		case ORIENT_SPLIT:
+			if (s.active == 2) {
+				s.x2 += dx;
+				s.z2 += dz;
+			}
+			else {
+				s.x += dx;
+				s.z += dz;
+			}
+			break;
+	}
+	if (s.orient != ORIENT_SPLIT) {
+		s.x2 = s.x;
+		s.z2 = s.z;
+	}
+}
+
+/* Bit i set while level.switches[i] is held down by the block */
+static unsigned pressedSwitches (const Level &level, int c0, int c1, bool standing)
+{
+	const Bitboard &soft = level.planes[PLANE_SOFT_SWITCH];
+	const Bitboard &heavy = level.planes[PLANE_HEAVY_SWITCH];
+	bool any = false;
+	if (c0 >= 0)
+		any = soft.test(c0) || (standing && heavy.test(c0));
+	if (c1 >= 0)
+		any = any || soft.test(c1);
+	if (!any)
+		return 0;
+
+	unsigned mask = 0;
+	for (size_t i = 0; i < level.switches.size(); i++) {
+		int cell = level.switches[i].z*level.cols + level.switches[i].x;
+		if (soft.test(cell) ? (cell == c0 || cell == c1) : (standing && cell == c0))
+			mask |= 1u << i;
+	}
+	return mask;
+}
+
+/* Hands control to half 1 and joins the halves at the spots the split tile names */
+static int splitRules (const Level &level, BlockState &s)
+{
+	for (size_t i = 0; i < level.splits.size(); i++) {
+		const SplitBinding &sp = level.splits[i];
+		if (s.active == 2 && s.x2 == sp.handoffX && s.z2 == sp.handoffZ)
+			s.active = 1;
+		if (s.x == sp.mergeX1 && s.z == sp.mergeZ1 && s.x2 == sp.mergeX2 && s.z2 == sp.mergeZ2) {
+			if (s.z == s.z2) {
+				s.orient = ORIENT_LYING_X;
+				s.x = s.x < s.x2 ? s.x : s.x2;
+			}
+			else {
+				s.orient = ORIENT_LYING_Z;
+				s.z = s.z < s.z2 ? s.z : s.z2;
+			}
+			s.x2 = s.x;
+			s.z2 = s.z;
+			s.active = 0;
+			return EVENT_MERGE;
+		}
+	}
+	return 0;
+}
+
+static int stepRules (const Level &level, BlockState &s, int move)
+{
+	if (s.status != STATUS_PLAYING)
+		return 0;
+
+	int xs[2], zs[2];
+	int n = blockCells(s, xs, zs);
+	unsigned before = pressedSwitches(level, cellOf(level, xs[0], zs[0]), cellOf(level, xs[1], zs[1]), n == 1);
+
+	int events = EVENT_MOVED;
+	roll(s, move);
+
+	n = blockCells(s, xs, zs);
+	int c0 = cellOf(level, xs[0], zs[0]);
+	int c1 = cellOf(level, xs[1], zs[1]);
+	unsigned fired = pressedSwitches(level, c0, c1, n == 1) & ~before;
+	for (size_t i = 0; fired; i++, fired >>= 1) {
+		if (!(fired & 1))
+			continue;
+		unsigned bit = 1u << i;
+		if (level.switches[i].mode == SWITCH_TOGGLE)
+			s.switches ^= bit;
+		else if (level.switches[i].mode == SWITCH_OPEN)
+			s.switches |= bit;
+		else
+			s.switches &= ~bit;
+		events |= EVENT_SWITCH;
+	}
+
+	if (n == 1 && c0 >= 0 && level.planes[PLANE_SPLIT].test(c0)) {
+		for (size_t i = 0; i < level.splits.size(); i++) {
+			const SplitBinding &sp = level.splits[i];
+			if (sp.x != s.x || sp.z != s.z)
+				continue;
+			s.orient = ORIENT_SPLIT;
+			s.x = sp.x1;
+			s.z = sp.z1;
+			s.x2 = sp.x2;
+			s.z2 = sp.z2;
+			s.active = 2;
+			events |= EVENT_SPLIT;
+			break;
+		}
+	}
+	if (s.orient == ORIENT_SPLIT) {
+		events |= splitRules(level, s);
+		n = blockCells(s, xs, zs);
+		c0 = cellOf(level, xs[0], zs[0]);
+		c1 = cellOf(level, xs[1], zs[1]);
+	}
+
+	if (!solid(level, s.switches, c0) || !solid(level, s.switches, c1))
+		s.status = STATUS_FELL;
+	else if (n == 1 && level.planes[PLANE_FRAGILE].test(c0))
+		s.status = STATUS_FELL;
+	else if (n == 1 && level.planes[PLANE_GOAL].test(c0))
+		s.status = STATUS_WON;
+
+	if (s.status == STATUS_FELL)
+		events |= brokenCell(level, s) >= 0 ? EVENT_FELL | EVENT_BREAK : EVENT_FELL;
+	else if (s.status == STATUS_WON)
+		events |= EVENT_WON;
+	return events;
+}
+
+/****************
+ * Packed state *
+ ****************/
+static inline int packedCols (const Level &level)
+{
+	return level.cols + 2*PACK_PAD;
+}
+
+bool canPack (const Level &level)
+{
+	return packedCols(level)*(level.rows + 2*PACK_PAD) <= PACK_MAX_CELLS;
+}
+
+static inline uint32_t packCell (const Level &level, int x, int z)
+{
+	return (z + PACK_PAD)*packedCols(level) + x + PACK_PAD;
+}
+
+static inline void unpackCell (const Level &level, uint32_t cell, int &x, int &z)
+{
+	x = cell % packedCols(level) - PACK_PAD;
+	z = cell / packedCols(level) - PACK_PAD;
+}
+
+PackedState packState (const Level &level, const BlockState &s)
+{
+	uint32_t mode;
+	uint32_t half2 = 0;
+	switch (s.orient) {
+		case ORIENT_LYING_X:
+			mode = PACK_LYING_X;
+			break;
+		case ORIENT_LYING_Z:
+			mode = PACK_LYING_Z;
+			break;
+		case ORIENT_SPLIT:
+			mode = s.active == 1 ? PACK_SPLIT_1 : PACK_SPLIT_2;
+			half2 = packCell(level, s.x2, s.z2);
+			break;
+		default:
+			mode = s.status == STATUS_WON ? PACK_WON : PACK_STANDING;
+			break;
+	}
+	PackedState p = packCell(level, s.x, s.z) | half2 << 14 | mode << 28;
+	if (s.status == STATUS_FELL)
+		p |= PACKED_FELL;
+	return p;
+}
+
+void unpackState (const Level &level, PackedState p, BlockState &s)
+{
+	unpackCell(level, p & 0x3fff, s.x, s.z);
+	s.x2 = s.x;
+	s.z2 = s.z;
+	s.active = 0;
+	s.status = packedFell(p) ? STATUS_FELL : STATUS_PLAYING;
+	switch (packedMode(p)) {
+		case PACK_LYING_X:
+			s.orient = ORIENT_LYING_X;
+			break;
+		case PACK_LYING_Z:
+			s.orient = ORIENT_LYING_Z;
+			break;
+		case PACK_SPLIT_1:
+		case PACK_SPLIT_2:
+			s.orient = ORIENT_SPLIT;
+			s.active = packedMode(p) == PACK_SPLIT_1 ? 1 : 2;
+			unpackCell(level, (p >> 14) & 0x3fff, s.x2, s.z2);
+			break;
+		case PACK_WON:
+			s.orient = ORIENT_STANDING;
+			s.status = STATUS_WON;
+			break;
+		default:
+			s.orient = ORIENT_STANDING;
+			break;
+	}
+}
+
+/* True if the cell is on the board and its behaviour can change with the
+   switch state or triggers more than support, fall or goal */
+static bool dynamicCell (const Level &level, int x, int z)
+{
+	int cell = cellOf(level, x, z);
+	if (cell < 0)
+		return false;
+	return level.bridges.test(cell) ||
+		level.planes[PLANE_SOFT_SWITCH].test(cell) ||
+		level.planes[PLANE_HEAVY_SWITCH].test(cell) ||
+		level.planes[PLANE_SPLIT].test(cell);
+}
+
+void buildTransitions (Level &level)
+{
+	level.transitions.clear();
+	if (!canPack(level))
+		return;
+
+	int cells = packedCols(level)*(level.rows + 2*PACK_PAD);
+	level.transitions.assign(cells*3*4, PACKED_SLOW);
+	for (int cell = 0; cell < cells; cell++) {
+		for (int orient = 0; orient < 3; orient++) {
+			BlockState from;
+			unpackState(level, cell | orient << 28, from);
+			from.switches = 0;
+
+			int xs[2], zs[2];
+			int n = blockCells(from, xs, zs);
+			if (cellOf(level, xs[0], zs[0]) < 0 || cellOf(level, xs[n-1], zs[n-1]) < 0)
+				continue;
+
+			for (int move = 0; move < 4; move++) {
+				BlockState to = from;
+				roll(to, move);
+				blockCells(to, xs, zs);
+				if (dynamicCell(level, xs[0], zs[0]) || dynamicCell(level, xs[1], zs[1]))
+					continue;
+				to = from;
+				stepRules(level, to, move);
+				level.transitions[(cell*3 + orient)*4 + move] = packState(level, to);
+			}
+		}
+	}
+}
+
+static inline int transitionIndex (const Level &level, const BlockState &s, int move)
+{
+	int orient = s.orient == ORIENT_LYING_X ? PACK_LYING_X : s.orient == ORIENT_LYING_Z ? PACK_LYING_Z : PACK_STANDING;
+	return (packCell(level, s.x, s.z)*3 + orient)*4 + move;
+}
+
+int step (const Level &level, BlockState &s, int move)
+{
+	if (s.status != STATUS_PLAYING)
+		return 0;
+	if (s.orient == ORIENT_SPLIT || level.transitions.empty())
+		return stepRules(level, s, move);
+
+	PackedState next = level.transitions[transitionIndex(level, s, move)];
+	if (next == PACKED_SLOW)
+		return stepRules(level, s, move);
+
+	unpackState(level, next, s);
+	if (s.status == STATUS_FELL)
+		return brokenCell(level, s) >= 0 ? EVENT_MOVED | EVENT_FELL | EVENT_BREAK : EVENT_MOVED | EVENT_FELL;
+	if (s.status == STATUS_WON)
+		return EVENT_MOVED | EVENT_WON;
+	return EVENT_MOVED;
+}
+
+PackedState stepPacked (const Level &level, PackedState p, unsigned &switches, int move)
+{
+	if (packedFell(p) || packedWon(p))
+		return p;
+	int mode = packedMode(p);
+	if (mode <= PACK_LYING_Z && !level.transitions.empty()) {
+		PackedState next = level.transitions[((p & 0x3fff)*3 + mode)*4 + move];
+		if (next != PACKED_SLOW)
+			return next;
+	}
+
+	BlockState s;
+	s.switches = switches;
+	unpackState(level, p, s);
+	stepRules(level, s, move);
+	switches = s.switches;
+	return packState(level, s);
+}
@@ -0,0 +1,178 @@
+#ifndef BLOXORZ_H
+#define BLOXORZ_H
+
+#include <stdint.h>
+#include <vector>
+
+/*
+ * Game rules without any GL, GLFW or FTGL dependency.
+ * Cells are addressed as (x, z): x is the column (world +x is right),
+ * z is the row (world +z is towards the viewer, "down" on the keyboard).
+ */
+
+#define BOARD_ROWS 10
+#define BOARD_COLS 15
+
+enum Tile {
+	TILE_EMPTY = 0,
+	TILE_FLOOR = 1,
+	TILE_SOFT_SWITCH = 2,	// fires when either half of the block lands on it
+	TILE_HEAVY_SWITCH = 3,	// fires only when the block stands on it
+	TILE_GOAL = 4,
+	TILE_LIGHT = 5,		// plain floor, always drawn in the light floor colour
+	TILE_FRAGILE = 6,	// gives way when the block stands on it
+	TILE_SPLIT = 7		// splits the block in two when stood on
+};
+
+/* One bit per cell, cell = z*cols + x */
+struct Bitboard {
+	std::vector<uint64_t> words;
+
+	void reset (int cells) { words.assign((cells + 63) / 64, 0); }
+	bool test (int cell) const { return (words[cell >> 6] >> (cell & 63)) & 1; }
+	void set (int cell) { words[cell >> 6] |= (uint64_t)1 << (cell & 63); }
+	void clear (int cell) { words[cell >> 6] &= ~((uint64_t)1 << (cell & 63)); }
+};
+
+/* PLANE_FLOOR holds every cell the block can rest on; the other
+   planes mark which of those cells are special */
+enum Plane {
+	PLANE_FLOOR,
+	PLANE_SOFT_SWITCH,
+	PLANE_HEAVY_SWITCH,
+	PLANE_GOAL,
+	PLANE_FRAGILE,
+	PLANE_SPLIT,
+	PLANE_LIGHT,
+	PLANE_COUNT
+};
+
+enum Move { MOVE_UP, MOVE_DOWN, MOVE_LEFT, MOVE_RIGHT };
+
+enum Orientation { ORIENT_STANDING, ORIENT_LYING_X, ORIENT_LYING_Z, ORIENT_SPLIT };
+
+enum Status { STATUS_PLAYING, STATUS_FELL, STATUS_WON };
+
+/* Bits returned by step() */
+enum {
+	EVENT_MOVED = 1,
+	EVENT_SWITCH = 2,
+	EVENT_SPLIT = 4,
+	EVENT_MERGE = 8,
+	EVENT_FELL = 16,
+	EVENT_WON = 32,
+	EVENT_BREAK = 64	// a fragile tile gave way under the standing block
+};
+
+enum SwitchMode { SWITCH_TOGGLE, SWITCH_OPEN, SWITCH_CLOSE };
+
+/* A switch tile and the cells it flips between empty and floor */
+struct SwitchBinding {
+	int x, z;
+	int mode;
+	Bitboard targets;
+};
+
+/* A split tile: where the halves land, where control passes from half 2
+   to half 1, and where the two halves join up again */
+struct SplitBinding {
+	int x, z;
+	int x1, z1, x2, z2;
+	int handoffX, handoffZ;
+	int mergeX1, mergeZ1, mergeX2, mergeZ2;
+};
+
+/*
+ * Block pose packed into 32 bits for search and replay. Cells are counted
+ * on the board padded by PACK_PAD cells on every side, so a block that
+ * has just rolled over the edge still has a position.
+ *   bits  0-13  half 1 (the standing cell, the lower cell when lying)
+ *   bits 14-27  half 2 while split, 0 otherwise
+ *   bits 28-30  PACK_* mode
+ *   bit  31     fallen
+ * Switch bits are not part of it and travel alongside.
+ */
+typedef uint32_t PackedState;
+
+enum { PACK_STANDING, PACK_LYING_X, PACK_LYING_Z, PACK_SPLIT_2, PACK_SPLIT_1, PACK_WON };
+
+#define PACK_PAD 2
+#define PACK_MAX_CELLS (1 << 14)	// only the solvers need this; see canPack()
+#define PACKED_FELL 0x80000000u
+#define PACKED_SLOW 0xffffffffu	// transition entry that needs the full rules
+
+/* Sanity cap the level files put on cols and rows. The game plays any
+   such board, falling back to the full rules where canPack() fails. */
+#define LEVEL_MAX_SIDE 2048
+
+struct Level {
+	int rows, cols;
+	Bitboard planes[PLANE_COUNT];
+	Bitboard bridges;	// every cell some switch flips
+	int startX, startZ;
+	float cameraX, cameraZ;	// offset added to the follow cameras' eye
+	std::vector<SwitchBinding> switches;
+	std::vector<SplitBinding> splits;
+
+	/* Next state for every unsplit pose and move, indexed
+	   ((padded cell)*3 + PACK_* orientation)*4 + move. PACKED_SLOW
+	   where switches, bridges or split tiles are involved. Empty when
+	   the board is too large to pack. */
+	std::vector<PackedState> transitions;
+};
+
+struct BlockState {
+	int x, z;		// standing cell, lower cell when lying, half 1 when split
+	int orient;
+	int x2, z2;		// half 2 while split
+	int active;		// half that moves while split (1 or 2)
+	unsigned switches;	// bit i set while level.switches[i] is on
+	int status;
+};
+
+/* Empty cols x rows board with no switches or split tiles */
+void resetLevel (Level &level, int cols, int rows);
+
+/* Stores a TILE_* value; unknown non-zero values count as plain floor */
+void setTile (Level &level, int x, int z, int tile);
+
+/* Switch on (x, z) with no targets yet; returns its index */
+int addSwitch (Level &level, int x, int z, int mode);
+void addSwitchTarget (Level &level, int index, int x, int z);
+void addSplit (Level &level, int x, int z, int x1, int z1, int x2, int z2, int hx, int hz, int mx1, int mz1, int mx2, int mz2);
+
+BlockState startState (const Level &level);
+
+/* Tile at (x, z) with the switch state of s applied; TILE_EMPTY off the
+   board and on the fragile tile the block broke */
+int tileAt (const Level &level, const BlockState &s, int x, int z);
+
+/* Cell of the fragile tile the block stood on and broke, or -1. The
+   block has fallen by then, so this needs no room in a PackedState. */
+int brokenCell (const Level &level, const BlockState &s);
+
+/* Cells covered by the block. Returns 1 when standing (both entries are
+   the same cell), 2 otherwise. Entry 0 is half 1, entry 1 is half 2. */
+int blockCells (const BlockState &s, int xs[2], int zs[2]);
+
+/* Applies one move and returns the EVENT_* bits it caused.
+   Does nothing once the block has fallen or reached the goal. */
+int step (const Level &level, BlockState &s, int move);
+
+/* Fills level.transitions; call after the tiles and bindings are final */
+void buildTransitions (Level &level);
+
+/* False when the padded board has more than PACK_MAX_CELLS cells */
+bool canPack (const Level &level);
+
+PackedState packState (const Level &level, const BlockState &s);
+void unpackState (const Level &level, PackedState p, BlockState &s);	// keeps s.switches
+
+/* step() on packed states; switches is updated in place */
+PackedState stepPacked (const Level &level, PackedState p, unsigned &switches, int move);
+
+static inline int packedMode (PackedState p) { return (p >> 28) & 7; }
+static inline bool packedFell (PackedState p) { return (p & PACKED_FELL) != 0; }
+static inline bool packedWon (PackedState p) { return !packedFell(p) && packedMode(p) == PACK_WON; }
+
+#endif
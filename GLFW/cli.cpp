@@ -0,0 +1,356 @@
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "bloxorz.h"
+#include "solver.h"
+#include "generator.h"
+#include "levelfile.h"
+#include "levelpack.h"
+#include "cli.h"
+
+static double elapsedMs (std::chrono::steady_clock::time_point since)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+/* Whole-argument number parsing: trailing junk or a value out of range
+   is an error rather than a silent 0 */
+static bool readInt (const char *arg, long min, long max, int &out)
+{
+	char *end;
+	errno = 0;
+	long v = strtol(arg, &end, 10);
+	if (end == arg || *end || errno == ERANGE || v < min || v > max)
+		return false;
+	out = (int)v;
+	return true;
+}
+
+static bool readCount (const char *arg, uint64_t &out)
+{
+	char *end;
+	errno = 0;
+	out = strtoull(arg, &end, 10);
+	return arg[0] >= '0' && arg[0] <= '9' && !*end && errno != ERANGE;	// strtoull takes "-1"
+}
+
+static bool readDouble (const char *arg, double min, double &out)
+{
+	char *end;
+	out = strtod(arg, &end);
+	return end != arg && !*end && std::isfinite(out) && out >= min;
+}
+
+/* COLSxROWS */
+static bool readSize (const char *arg, int &cols, int &rows)
+{
+	char *end;
+	errno = 0;
+	long c = strtol(arg, &end, 10);
+	if (end == arg || *end != 'x' || errno == ERANGE || c < 1 || c > PACK_MAX_CELLS)
+		return false;
+	const char *r = end + 1;
+	long n = strtol(r, &end, 10);
+	if (end == r || *end || errno == ERANGE || n < 1 || n > PACK_MAX_CELLS)
+		return false;
+	cols = (int)c;
+	rows = (int)n;
+	return true;
+}
+
+static int badValue (const char *option, const char *arg)
+{
+	fprintf(stderr, "Error: bad value for %s: %s\n", option, arg);
+	return 2;
+}
+
+enum { SOLVER_BFS, SOLVER_ASTAR, SOLVER_PARALLEL };
+
+/* A text pack parsed up front, or a binary pack decoded level by level */
+struct PackSource {
+	std::vector<Level> text;
+	LevelPackFile binary;
+
+	size_t count () const { return binary.isOpen() ? binary.count() : text.size(); }
+	bool get (size_t i, Level &level) const
+	{
+		if (binary.isOpen()) {
+			if (!binary.read(i, level))
+				return false;
+			buildTransitions(level);	// worth it for a search
+			return true;
+		}
+		level = text[i];
+		return true;
+	}
+};
+
+static bool openPack (const char *path, PackSource &pack)
+{
+	std::string error;
+	if (pack.binary.open(path, error) || loadLevelPack(path, pack.text, error))
+		return true;
+	fprintf(stderr, "Error: %s: %s\n", path, error.c_str());
+	return false;
+}
+
+static int solveCommand (const char *packPath, int stage, int solver, int threads)
+{
+	PackSource pack;
+	if (!openPack(packPath, pack))
+		return 2;
+	Level level;
+	if (stage < 1 || stage > (int)pack.count() || !pack.get(stage - 1, level)) {
+		fprintf(stderr, "Error: no stage %d\n", stage);
+		return 2;
+	}
+
+	Solution sol;
+	std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+	if (solver == SOLVER_ASTAR)
+		solveAStar(level, sol);
+	else if (solver == SOLVER_PARALLEL)
+		solveParallelBFS(level, sol, threads);
+	else
+		solveBFS(level, sol);
+	double ms = elapsedMs(t0);
+
+	if (!sol.solved) {
+		printf("stage %d: no solution (%ld states explored, %.2f ms, %zu KB peak)\n", stage, sol.explored, ms, sol.peakBytes / 1024);
+		return 1;
+	}
+	printf("stage %d: %s (%d moves, %ld states explored, %.2f ms, %zu KB peak)\n", stage, sol.moves.c_str(), (int)sol.moves.size(), sol.explored, ms, sol.peakBytes / 1024);
+	return 0;
+}
+
+struct LevelReport {
+	bool read;
+	Solution sol;
+	Reachability reach;
+	double ms;
+};
+
+struct ValidateJob {
+	const PackSource *pack;
+	std::vector<LevelReport> reports;
+	std::atomic<size_t> cursor;
+};
+
+/* Pool worker: takes the next unvalidated level until none are left */
+static void validateLevels (ValidateJob *job)
+{
+	Level level;	// reused, so binary packs decode without allocating
+	for (;;) {
+		size_t i = job->cursor.fetch_add(1);
+		if (i >= job->reports.size())
+			break;
+		LevelReport &r = job->reports[i];
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+		r.read = job->pack->get(i, level);
+		if (!r.read)
+			resetLevel(level, 1, 1);
+		solveBFS(level, r.sol);
+		exploreLevel(level, r.reach);
+		r.ms = elapsedMs(t0);
+	}
+}
+
+/* One JSON object per line so large packs can be streamed and grepped */
+static void writeReport (FILE *out, int number, const LevelReport &r)
+{
+	size_t peak = r.sol.peakBytes > r.reach.peakBytes ? r.sol.peakBytes : r.reach.peakBytes;
+	if (!r.read) {
+		fprintf(out, "{\"level\": %d, \"error\": \"corrupt record\"}\n", number);
+		return;
+	}
+	fprintf(out, "{\"level\": %d, \"solvable\": %s, \"moves\": %d, \"solution\": \"%s\", "
+		"\"states_explored\": %ld, \"reachable_states\": %ld, \"soft_locks\": %ld, "
+		"\"wall_ms\": %.3f, \"peak_kb\": %zu}\n",
+		number, r.sol.solved ? "true" : "false", r.sol.solved ? (int)r.sol.moves.size() : -1,
+		r.sol.moves.c_str(), r.sol.explored, r.reach.states, r.reach.deadEnds, r.ms, peak / 1024);
+}
+
+static int validateCommand (const char *packPath, int threads, const char *outPath)
+{
+	PackSource pack;
+	if (!openPack(packPath, pack))
+		return 2;
+	ValidateJob job;
+	job.pack = &pack;
+	job.reports.resize(pack.count());
+
+	FILE *out = stdout;
+	if (outPath && !(out = fopen(outPath, "w"))) {
+		fprintf(stderr, "Error: cannot write %s\n", outPath);
+		return 2;
+	}
+
+	if (threads <= 0)
+		threads = std::thread::hardware_concurrency();
+	if (threads > (int)pack.count())
+		threads = pack.count();
+	job.cursor = 0;
+	std::vector<std::thread> pool;
+	for (int t = 1; t < threads; t++)
+		pool.push_back(std::thread(validateLevels, &job));
+	validateLevels(&job);
+	for (size_t t = 0; t < pool.size(); t++)
+		pool[t].join();
+
+	int failed = 0;
+	for (size_t i = 0; i < job.reports.size(); i++) {
+		writeReport(out, i + 1, job.reports[i]);
+		if (!job.reports[i].sol.solved)
+			failed++;
+	}
+	if (out != stdout)
+		fclose(out);
+	if (failed)
+		fprintf(stderr, "%d of %d levels have no solution\n", failed, (int)job.reports.size());
+	return failed ? 1 : 0;
+}
+
+static int generateCommand (size_t count, uint64_t seed, const GeneratorParams &params, int threads, const char *outPath)
+{
+	FILE *out = stdout;
+	if (outPath && !(out = fopen(outPath, "w"))) {
+		fprintf(stderr, "Error: cannot write %s\n", outPath);
+		return 2;
+	}
+
+	std::vector<GeneratedLevel> pack;
+	generatePack(params, seed, count, threads, pack);
+
+	int failed = 0;
+	fprintf(out, "# Generated with --seed %llu\n", (unsigned long long)seed);
+	for (size_t i = 0; i < pack.size(); i++) {
+		const GeneratedLevel &g = pack[i];
+		if (!g.ok) {
+			failed++;
+			continue;
+		}
+		fprintf(out, "\n# index %zu, par %d, branching %.3f, %d attempts\n# %s\n",
+			i, (int)g.sol.moves.size(), g.branching, g.attempts, g.sol.moves.c_str());
+		writeLevel(out, g.level, i + 1 - failed);
+	}
+	if (out != stdout)
+		fclose(out);
+	if (failed)
+		fprintf(stderr, "%d of %d levels hit the attempt limit\n", failed, (int)count);
+	return failed ? 1 : 0;
+}
+
+static int buildPackCommand (const char *inPath, const char *outPath)
+{
+	std::vector<Level> levels;
+	std::string error;
+	if (!loadLevelPack(inPath, levels, error)) {
+		fprintf(stderr, "Error: %s: %s\n", inPath, error.c_str());
+		return 2;
+	}
+	if (!writeLevelPack(outPath, levels, error)) {
+		fprintf(stderr, "Error: %s\n", error.c_str());
+		return 2;
+	}
+	return 0;
+}
+
+int runCommand (int argc, char **argv)
+{
+	if (argc < 2)
+		return -1;
+	if (strcmp(argv[1], "--solve") == 0) {
+		if (argc < 3) {
+			fprintf(stderr, "usage: %s --solve N [--pack FILE] [--astar | --threads T]\n", argv[0]);
+			return 2;
+		}
+		int solver = SOLVER_BFS, threads = 0, stage;
+		const char *packPath = DEFAULT_LEVEL_PACK;
+		if (!readInt(argv[2], 1, 0x7fffffff, stage))
+			return badValue("--solve", argv[2]);
+		for (int i = 3; i < argc; i++) {
+			if (strcmp(argv[i], "--astar") == 0)
+				solver = SOLVER_ASTAR;
+			else if (strcmp(argv[i], "--pack") == 0 && i + 1 < argc)
+				packPath = argv[++i];
+			else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+				solver = SOLVER_PARALLEL;
+				if (!readInt(argv[++i], 0, 4096, threads))
+					return badValue(argv[i-1], argv[i]);
+			}
+		}
+		return solveCommand(packPath, stage, solver, threads);
+	}
+	if (strcmp(argv[1], "--validate") == 0) {
+		if (argc < 3) {
+			fprintf(stderr, "usage: %s --validate PACKFILE [--threads T] [--out FILE]\n", argv[0]);
+			return 2;
+		}
+		int threads = 0;
+		const char *outPath = NULL;
+		for (int i = 3; i + 1 < argc; i++) {
+			if (strcmp(argv[i], "--threads") == 0) {
+				if (!readInt(argv[++i], 0, 4096, threads))
+					return badValue(argv[i-1], argv[i]);
+			}
+			else if (strcmp(argv[i], "--out") == 0)
+				outPath = argv[++i];
+		}
+		return validateCommand(argv[2], threads, outPath);
+	}
+	if (strcmp(argv[1], "--build-pack") == 0) {
+		if (argc < 4) {
+			fprintf(stderr, "usage: %s --build-pack LEVELS.txt OUT.pack\n", argv[0]);
+			return 2;
+		}
+		return buildPackCommand(argv[2], argv[3]);
+	}
+	if (strcmp(argv[1], "--generate") == 0) {
+		if (argc < 3) {
+			fprintf(stderr, "usage: %s --generate COUNT [--seed S] [--size COLSxROWS] [--min-moves M] "
+				"[--min-branching B] [--switches K] [--threads T] [--out FILE]\n", argv[0]);
+			return 2;
+		}
+		GeneratorParams params = defaultGeneratorParams();
+		uint64_t seed = 1, count;
+		int threads = 0;
+		const char *outPath = NULL;
+		if (!readCount(argv[2], count))
+			return badValue("--generate", argv[2]);
+		for (int i = 3; i + 1 < argc; i++) {
+			bool ok = true;
+			if (strcmp(argv[i], "--seed") == 0)
+				ok = readCount(argv[++i], seed);
+			else if (strcmp(argv[i], "--size") == 0)
+				ok = readSize(argv[++i], params.cols, params.rows);
+			else if (strcmp(argv[i], "--min-moves") == 0)
+				ok = readInt(argv[++i], 0, 1 << 16, params.minMoves);
+			else if (strcmp(argv[i], "--min-branching") == 0)
+				ok = readDouble(argv[++i], 0, params.minBranching);
+			else if (strcmp(argv[i], "--switches") == 0)
+				ok = readInt(argv[++i], 0, 32, params.maxSwitches);
+			else if (strcmp(argv[i], "--threads") == 0)
+				ok = readInt(argv[++i], 0, 4096, threads);
+			else if (strcmp(argv[i], "--out") == 0)
+				outPath = argv[++i];
+			if (!ok)
+				return badValue(argv[i-1], argv[i]);
+		}
+		// Boards the solver cannot pack would burn every attempt
+		Level probe;
+		resetLevel(probe, params.cols, params.rows);
+		if (params.cols < 2 || params.rows < 2 || !canPack(probe)) {
+			fprintf(stderr, "Error: --size %dx%d: need at least 2x2 and (cols+4)*(rows+4) at most %d\n",
+				params.cols, params.rows, PACK_MAX_CELLS);
+			return 2;
+		}
+		return generateCommand(count, seed, params, threads, outPath);
+	}
+	return -1;
+}
@@ -0,0 +1,10 @@
+#ifndef CLI_H
+#define CLI_H
+
+/* Headless command line modes (--solve, --validate, --generate,
+   --build-pack).
+   Returns the exit code, or -1 when argv does not ask for one and the
+   game should start. */
+int runCommand (int argc, char **argv);
+
+#endif
@@ -1,14 +1,18 @@
 #version 330 core
 
-// Interpolated values from the vertex shaders
-in vec3 fragColor;
+// distance to the glyph outline, 0.5 on it and more inside
+uniform sampler2D atlas;
+
+in vec2 atlasUV;
+in vec4 fragColor;
 
 // output data
-out vec3 color;
+out vec4 color;
 
 void main()
 {
-    // Output color = color specified in the vertex shader,
-    // interpolated between all 3 surrounding vertices of the triangle
-    color = fragColor;
-}
\ No newline at end of file
+    float distance = texture(atlas, atlasUV).r;
+    // antialias over about one screen pixel, whatever the text scale
+    float width = fwidth(distance);
+    color = vec4(fragColor.rgb, fragColor.a * smoothstep(0.5 - width, 0.5 + width, distance));
+}
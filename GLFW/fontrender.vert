@@ -1,17 +1,23 @@
 #version 330 core
 
-uniform mat4 MVP;
-uniform vec3 pen;
-uniform vec3 fontColor;
+// laid out as in Sample_GL.vert
+layout (std140) uniform Frame {
+    mat4 VP;
+    vec4 eye;
+    float time;
+};
 
-in vec3 vertexPosition;
-in vec3 vertexNormal;
+// input data : glyph corners, already placed by drawText
+layout (location = 0) in vec3 vertexPosition;
+layout (location = 1) in vec2 vertexUV;
+layout (location = 2) in vec4 vertexColor;
 
-out vec3 fragColor;
+out vec2 atlasUV;
+out vec4 fragColor;
 
 void main ()
 {
-    gl_Position = MVP * (vec4(vertexPosition, 1.0) + vec4(pen, 1.0));
-    // fragColor = vec3((vertexNormal.x+1)/2,(vertexNormal.y+1)/2,(vertexNormal.z+1)/2);
-    fragColor = fontColor;
-}
\ No newline at end of file
+    gl_Position = VP * vec4(vertexPosition, 1.0);
+    atlasUV = vertexUV;
+    fragColor = vertexColor;
+}
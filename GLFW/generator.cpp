@@ -0,0 +1,253 @@
+#include <atomic>
+#include <thread>
+#include "generator.h"
+
+GeneratorParams defaultGeneratorParams ()
+{
+	GeneratorParams p;
+	p.cols = BOARD_COLS;
+	p.rows = BOARD_ROWS;
+	p.minMoves = 10;
+	p.minBranching = 1.5;
+	p.maxSwitches = 2;
+	p.fragilePercent = 10;
+	p.splits = true;
+	p.attempts = 2000;
+	return p;
+}
+
+/* splitmix64: same sequence on every platform, unlike rand() */
+struct Rng {
+	uint64_t state;
+
+	uint64_t next ()
+	{
+		uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+	int below (int n) { return (int)(next() % (uint64_t)n); }
+	bool chance (int percent) { return below(100) < percent; }
+};
+
+struct Candidate {
+	std::vector<char> grid;		// TILE_* per cell
+	std::vector<char> stood;	// the carving walk stood here
+	std::vector<int> path;		// cells the walk covered, in order
+	int start, goal;
+};
+
+static void cover (Candidate &c, const Level &open, const BlockState &s)
+{
+	int xs[2], zs[2];
+	int n = blockCells(s, xs, zs);
+	for (int k = 0; k < n; k++) {
+		int cell = zs[k]*open.cols + xs[k];
+		c.grid[cell] = TILE_FLOOR;
+		c.path.push_back(cell);
+		if (n == 1)
+			c.stood[cell] = 1;
+	}
+}
+
+/* Rolls a block at random over an all-floor board and keeps the cells it
+   touched, so the candidate starts out with at least one way through */
+static bool carve (const GeneratorParams &params, const Level &open, Rng &rng, Candidate &c)
+{
+	int cells = params.cols*params.rows;
+	c.grid.assign(cells, TILE_EMPTY);
+	c.stood.assign(cells, 0);
+	c.path.clear();
+
+	BlockState s = startState(open);
+	s.x = rng.below(params.cols);
+	s.z = rng.below(params.rows);
+	s.x2 = s.x;
+	s.z2 = s.z;
+	c.start = s.z*params.cols + s.x;
+	cover(c, open, s);
+
+	// Walks double back a lot, so roll well past the requested length
+	int length = 2*params.minMoves + rng.below(2*params.minMoves + 1);
+	for (int k = 0; k < length || s.orient != ORIENT_STANDING; k++) {
+		if (k > length + 16)
+			return false;
+		BlockState next = s;
+		if (step(open, next, rng.below(4)) & EVENT_FELL)
+			continue;
+		s = next;
+		cover(c, open, s);
+	}
+	c.goal = s.z*params.cols + s.x;
+	return c.goal != c.start;
+}
+
+static bool usable (const Candidate &c, int cell)
+{
+	return cell != c.start && cell != c.goal && c.grid[cell] == TILE_FLOOR;
+}
+
+static void buildCandidate (const GeneratorParams &params, Rng &rng, Candidate &c, Level &level)
+{
+	int cols = params.cols, rows = params.rows;
+
+	// Widen the path with side floor so there is more than one way to roll
+	std::vector<char> carved(c.grid);
+	for (int z = 0; z < rows; z++)
+		for (int x = 0; x < cols; x++) {
+			int cell = z*cols + x;
+			if (carved[cell] != TILE_EMPTY || !rng.chance(35))
+				continue;
+			if ((x > 0 && carved[cell-1]) || (x+1 < cols && carved[cell+1]) ||
+			    (z > 0 && carved[cell-cols]) || (z+1 < rows && carved[cell+cols]))
+				c.grid[cell] = TILE_FLOOR;
+		}
+
+	for (int cell = 0; cell < cols*rows; cell++)
+		if (usable(c, cell) && !c.stood[cell] && rng.chance(params.fragilePercent))
+			c.grid[cell] = TILE_FRAGILE;
+	c.grid[c.goal] = TILE_GOAL;
+
+	resetLevel(level, cols, rows);
+	level.startX = c.start % cols;
+	level.startZ = c.start / cols;
+
+	// A switch early on the walk opens a bridge over cells the walk needs later
+	int switches = rng.below(params.maxSwitches + 1);
+	int pathLen = c.path.size();
+	for (int k = 0; k < switches && pathLen > 8; k++) {
+		int at = rng.below(pathLen / 2);
+		int from = at + 1 + rng.below(pathLen - at - 2);
+		int sw = c.path[at];
+		if (!usable(c, sw))
+			continue;
+		bool heavy = c.stood[sw] && rng.chance(50);
+		int index = addSwitch(level, sw % cols, sw / cols, rng.chance(75) ? SWITCH_TOGGLE : SWITCH_OPEN);
+		c.grid[sw] = heavy ? TILE_HEAVY_SWITCH : TILE_SOFT_SWITCH;
+		for (int run = 1 + rng.below(3); run > 0 && from < pathLen; run--, from++) {
+			int cell = c.path[from];
+			if (!usable(c, cell))
+				continue;
+			c.grid[cell] = TILE_EMPTY;
+			addSwitchTarget(level, index, cell % cols, cell / cols);
+		}
+	}
+
+	if (params.splits && pathLen > 8 && rng.chance(30)) {
+		int sp = c.path[rng.below(pathLen)];
+		int l1 = c.path[rng.below(pathLen)], l2 = c.path[rng.below(pathLen)];
+		int m2 = c.path[rng.below(pathLen)];
+		int m1 = rng.chance(50) ? m2 + 1 : m2 + cols;
+		bool fits = m1 < cols*rows && (m1 % cols) >= (m2 % cols);
+		if (fits && c.stood[sp] && usable(c, sp) && l1 != l2 && l1 != sp && l2 != sp &&
+		    c.grid[l1] == TILE_FLOOR && c.grid[l2] == TILE_FLOOR &&
+		    c.grid[m1] == TILE_FLOOR && c.grid[m2] == TILE_FLOOR) {
+			c.grid[sp] = TILE_SPLIT;
+			addSplit(level, sp % cols, sp / cols, l1 % cols, l1 / cols, l2 % cols, l2 / cols,
+				m2 % cols, m2 / cols, m1 % cols, m1 / cols, m2 % cols, m2 / cols);
+		}
+	}
+
+	for (int z = 0; z < rows; z++)
+		for (int x = 0; x < cols; x++)
+			setTile(level, x, z, c.grid[z*cols + x]);
+	buildTransitions(level);
+}
+
+/* Average number of moves that do not drop the block, over the states
+   the solution passes through */
+static double pathBranching (const Level &level, const Solution &sol)
+{
+	BlockState s = startState(level);
+	PackedState p = packState(level, s);
+	unsigned switches = s.switches;
+	int safe = 0;
+	for (size_t i = 0; i < sol.moves.size(); i++) {
+		int chosen = 0;
+		for (int move = 0; move < 4; move++) {
+			unsigned sw = switches;
+			PackedState next = stepPacked(level, p, sw, move);
+			if (!packedFell(next))
+				safe++;
+			if (moveName(move) == sol.moves[i])
+				chosen = move;
+		}
+		p = stepPacked(level, p, switches, chosen);
+	}
+	return sol.moves.empty() ? 0 : (double)safe / sol.moves.size();
+}
+
+bool generateLevel (const GeneratorParams &params, uint64_t seed, uint64_t index, GeneratedLevel &out)
+{
+	Rng rng = { seed ^ (index + 1) * 0xd1b54a32d192ed03ull };
+	rng.next();
+	out.ok = false;
+	out.branching = 0;
+	out.attempts = 0;
+	if (params.minMoves < 0 || params.cols < 1 || params.rows < 1 || params.cols > PACK_MAX_CELLS || params.rows > PACK_MAX_CELLS)
+		return false;
+
+	Level open;
+	resetLevel(open, params.cols, params.rows);
+	if (!canPack(open))
+		return false;	// the solver could not judge the candidates
+	for (int z = 0; z < params.rows; z++)
+		for (int x = 0; x < params.cols; x++)
+			setTile(open, x, z, TILE_FLOOR);
+
+	Candidate c;
+	for (out.attempts = 1; out.attempts <= params.attempts; out.attempts++) {
+		if (!carve(params, open, rng, c))
+			continue;
+		buildCandidate(params, rng, c, out.level);
+		if (!solveBFS(out.level, out.sol) || (int)out.sol.moves.size() < params.minMoves)
+			continue;
+		out.branching = pathBranching(out.level, out.sol);
+		if (out.branching < params.minBranching)
+			continue;
+		out.ok = true;
+		return true;
+	}
+	out.attempts = params.attempts;
+	return false;
+}
+
+struct GenerateJob {
+	const GeneratorParams *params;
+	uint64_t seed;
+	std::vector<GeneratedLevel> *out;
+	std::atomic<size_t> cursor;
+};
+
+static void generateLevels (GenerateJob *job)
+{
+	for (;;) {
+		size_t i = job->cursor.fetch_add(1);
+		if (i >= job->out->size())
+			break;
+		generateLevel(*job->params, job->seed, i, (*job->out)[i]);
+	}
+}
+
+void generatePack (const GeneratorParams &params, uint64_t seed, size_t count, int threads, std::vector<GeneratedLevel> &out)
+{
+	out.clear();
+	out.resize(count);
+	GenerateJob job;
+	job.params = &params;
+	job.seed = seed;
+	job.out = &out;
+	job.cursor = 0;
+
+	if (threads <= 0)
+		threads = std::thread::hardware_concurrency();
+	if (threads > (int)count)
+		threads = count;
+	std::vector<std::thread> pool;
+	for (int t = 1; t < threads; t++)
+		pool.push_back(std::thread(generateLevels, &job));
+	generateLevels(&job);
+	for (size_t t = 0; t < pool.size(); t++)
+		pool[t].join();
+}
@@ -0,0 +1,37 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <vector>
+#include "bloxorz.h"
+#include "solver.h"
+
+struct GeneratorParams {
+	int cols, rows;
+	int minMoves;		// shortest solution must be at least this long
+	double minBranching;	// average safe moves per state along that solution
+	int maxSwitches;
+	int fragilePercent;	// share of floor cells off the carved path made fragile
+	bool splits;		// allow a split tile (7)
+	int attempts;		// candidates tried per level before giving up
+};
+
+/* 15x10 boards, at least 10 moves, up to 2 switches, a few fragile tiles */
+GeneratorParams defaultGeneratorParams ();
+
+struct GeneratedLevel {
+	Level level;
+	Solution sol;
+	double branching;
+	int attempts;		// candidates tried, including the accepted one
+	bool ok;
+};
+
+/* Level index of the pack grown from seed. The result depends only on
+   params, seed and index, never on thread count or order. Fails at
+   once on a negative minMoves or a board canPack() refuses. */
+bool generateLevel (const GeneratorParams &params, uint64_t seed, uint64_t index, GeneratedLevel &out);
+
+/* Levels 0..count-1 of the pack, spread over threads (<= 0: every core) */
+void generatePack (const GeneratorParams &params, uint64_t seed, size_t count, int threads, std::vector<GeneratedLevel> &out);
+
+#endif
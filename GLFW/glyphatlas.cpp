@@ -0,0 +1,117 @@
+#include <cmath>
+#include <cstring>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include "glyphatlas.h"
+
+#define ATLAS_WIDTH 512
+
+/* Field of one rendered glyph bitmap, padded by GLYPH_SPREAD on every
+   side: each texel looks for the nearest texel on the other side of
+   the outline, which is cheap at these sizes and done only once */
+static void distanceField (const FT_Bitmap &bitmap, int w, int h, std::vector<uint8_t> &out)
+{
+	std::vector<uint8_t> inside(w*h, 0);
+	for (unsigned r = 0; r < bitmap.rows; r++)
+		for (unsigned c = 0; c < bitmap.width; c++)
+			inside[(r + GLYPH_SPREAD)*w + c + GLYPH_SPREAD] = bitmap.buffer[r*bitmap.pitch + c] >= 128;
+
+	out.resize(w*h);
+	for (int y = 0; y < h; y++)
+		for (int x = 0; x < w; x++) {
+			bool in = inside[y*w + x];
+			float best = GLYPH_SPREAD + 0.5f;
+			for (int dy = -GLYPH_SPREAD; dy <= GLYPH_SPREAD; dy++) {
+				int ny = y + dy;
+				if (ny < 0 || ny >= h)
+					continue;
+				for (int dx = -GLYPH_SPREAD; dx <= GLYPH_SPREAD; dx++) {
+					int nx = x + dx;
+					if (nx < 0 || nx >= w || inside[ny*w + nx] == in)
+						continue;
+					float d = sqrtf(dx*dx + dy*dy);
+					if (d < best)
+						best = d;
+				}
+			}
+			// the outline runs between the two texel centres
+			float d = (best - 0.5f) / GLYPH_SPREAD;
+			float v = 128 + (in ? d : -d)*127;
+			out[y*w + x] = v < 0 ? 0 : v > 255 ? 255 : (uint8_t)v;
+		}
+}
+
+bool buildGlyphAtlas (const char *fontPath, GlyphAtlas &atlas, std::string &error)
+{
+	FT_Library library;
+	FT_Face face;
+	if (FT_Init_FreeType(&library)) {
+		error = "cannot start FreeType";
+		return false;
+	}
+	if (FT_New_Face(library, fontPath, 0, &face) || FT_Set_Pixel_Sizes(face, 0, GLYPH_PIXELS)) {
+		FT_Done_FreeType(library);
+		error = std::string("cannot load font ") + fontPath;
+		return false;
+	}
+
+	atlas.width = ATLAS_WIDTH;
+	atlas.height = 0;
+	atlas.pixels.clear();
+	int penX = 0, penY = 0, shelf = 0;
+	std::vector<uint8_t> field;
+	for (int c = GLYPH_FIRST; c <= GLYPH_LAST; c++) {
+		Glyph &g = atlas.glyphs[c - GLYPH_FIRST];
+		memset(&g, 0, sizeof g);
+		if (FT_Load_Char(face, c, FT_LOAD_RENDER))
+			continue;
+		FT_GlyphSlot slot = face->glyph;
+		g.advance = slot->advance.x / 64.0f / GLYPH_PIXELS;
+		if (slot->bitmap.width == 0 || slot->bitmap.rows == 0)
+			continue;	// blank, such as the space
+
+		int w = slot->bitmap.width + 2*GLYPH_SPREAD, h = slot->bitmap.rows + 2*GLYPH_SPREAD;
+		distanceField(slot->bitmap, w, h, field);
+
+		// shelf packing, one texel apart so filtering never bleeds
+		if (penX + w > ATLAS_WIDTH) {
+			penX = 0;
+			penY += shelf + 1;
+			shelf = 0;
+		}
+		if (penY + h > atlas.height) {
+			atlas.height = penY + h;
+			atlas.pixels.resize(atlas.width*atlas.height, 0);
+		}
+		for (int y = 0; y < h; y++)
+			memcpy(&atlas.pixels[(penY + y)*atlas.width + penX], &field[y*w], w);
+
+		g.x0 = (slot->bitmap_left - GLYPH_SPREAD) / (float)GLYPH_PIXELS;
+		g.y1 = (slot->bitmap_top + GLYPH_SPREAD) / (float)GLYPH_PIXELS;
+		g.x1 = g.x0 + w / (float)GLYPH_PIXELS;
+		g.y0 = g.y1 - h / (float)GLYPH_PIXELS;
+		g.u0 = penX;
+		g.u1 = penX + w;
+		g.v0 = penY + h;	// rows run top down, y runs up
+		g.v1 = penY;
+		penX += w + 1;
+		if (h > shelf)
+			shelf = h;
+	}
+	FT_Done_Face(face);
+	FT_Done_FreeType(library);
+
+	if (atlas.height == 0) {
+		error = std::string(fontPath) + " has no printable glyphs";
+		return false;
+	}
+	// texel positions to texture coordinates, now that the height is known
+	for (int c = GLYPH_FIRST; c <= GLYPH_LAST; c++) {
+		Glyph &g = atlas.glyphs[c - GLYPH_FIRST];
+		g.u0 /= atlas.width;
+		g.u1 /= atlas.width;
+		g.v0 /= atlas.height;
+		g.v1 /= atlas.height;
+	}
+	return true;
+}
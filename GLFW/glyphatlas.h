@@ -0,0 +1,44 @@
+#ifndef GLYPHATLAS_H
+#define GLYPHATLAS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+ * Signed distance field atlas of the printable ASCII glyphs of one
+ * font, built once with FreeType and without any GL dependency. A
+ * texel holds 128 on the glyph outline, more inside, less outside,
+ * reaching 0 and 255 GLYPH_SPREAD pixels away, so the glyphs stay
+ * sharp under the HUD's large scales.
+ *
+ * Glyph boxes and advances are in ems from the pen position on the
+ * baseline, y up, the same units FTGL used with FaceSize(1).
+ */
+
+#define GLYPH_FIRST 32
+#define GLYPH_LAST 126
+#define GLYPH_PIXELS 48		// em size the outlines are rendered at
+#define GLYPH_SPREAD 6		// pixels the field reaches past the outline
+
+struct Glyph {
+	float x0, y0, x1, y1;	// quad, including the spread
+	float u0, v0, u1, v1;	// the same corners in the atlas
+	float advance;
+};
+
+struct GlyphAtlas {
+	int width, height;
+	std::vector<uint8_t> pixels;	// one byte per texel, rows from the top
+	Glyph glyphs[GLYPH_LAST - GLYPH_FIRST + 1];
+
+	/* NULL for characters outside the atlas */
+	const Glyph *find (unsigned char c) const
+	{
+		return c >= GLYPH_FIRST && c <= GLYPH_LAST ? &glyphs[c - GLYPH_FIRST] : NULL;
+	}
+};
+
+bool buildGlyphAtlas (const char *fontPath, GlyphAtlas &atlas, std::string &error);
+
+#endif
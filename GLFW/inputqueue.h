@@ -0,0 +1,66 @@
+#ifndef INPUTQUEUE_H
+#define INPUTQUEUE_H
+
+#include <atomic>
+
+/*
+ * Input as it arrived, for the game to apply at one point of its loop
+ * rather than inside the window system's callbacks. One thread pushes
+ * and one pops, so the ring needs no lock: the pusher only writes
+ * head, the popper only writes tail.
+ */
+
+#define INPUT_SLOTS 256		// a power of two
+
+enum InputKind {
+	INPUT_KEY,
+	INPUT_MOUSE_BUTTON
+};
+
+struct InputEvent {
+	double time;		// seconds, when it was pushed
+	int kind;
+	int code;		// GLFW key or mouse button
+	int action;		// GLFW_PRESS, GLFW_RELEASE or GLFW_REPEAT
+	double x, y;		// cursor position, mouse buttons only
+};
+
+class InputQueue {
+public:
+	InputQueue () : dropped(0), head(0), tail(0) {}
+
+	/* False, and the event is lost, when the ring is full */
+	bool push (const InputEvent &e)
+	{
+		unsigned h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) >= INPUT_SLOTS) {
+			dropped++;
+			return false;
+		}
+		slots[h & (INPUT_SLOTS - 1)] = e;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	/* Oldest event first */
+	bool pop (InputEvent &e)
+	{
+		unsigned t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire))
+			return false;
+		e = slots[t & (INPUT_SLOTS - 1)];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	int dropped;		// pusher side only
+
+private:
+	InputEvent slots[INPUT_SLOTS];
+	std::atomic<unsigned> head, tail;
+
+	InputQueue (const InputQueue &);
+	void operator= (const InputQueue &);
+};
+
+#endif
@@ -0,0 +1,238 @@
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include "levelfile.h"
+
+static bool fail (std::string &error, int line, const char *what)
+{
+	char buf[128];
+	snprintf(buf, sizeof buf, "line %d: %s", line, what);
+	error = buf;
+	return false;
+}
+
+/* Reads count integers from *args and advances it past them; a value
+   that does not fit an int is an error, not a wrapped number */
+static bool readInts (const char **args, int *out, int count)
+{
+	for (int i = 0; i < count; i++) {
+		char *end;
+		errno = 0;
+		long v = strtol(*args, &end, 10);
+		if (end == *args || errno == ERANGE || v < INT_MIN || v > INT_MAX)
+			return false;
+		out[i] = (int)v;
+		*args = end;
+	}
+	return true;
+}
+
+static bool restIsBlank (const char *args)
+{
+	return args[strspn(args, " \t")] == '\0';
+}
+
+static bool onBoard (const Level &level, int x, int z)
+{
+	return x >= 0 && z >= 0 && x < level.cols && z < level.rows;
+}
+
+static bool parseSwitch (Level &level, const char *args)
+{
+	int xz[2];
+	if (!readInts(&args, xz, 2) || !onBoard(level, xz[0], xz[1]))
+		return false;
+	args += strspn(args, " \t");
+	int mode;
+	size_t len = strcspn(args, " \t");
+	if (len == 6 && strncmp(args, "toggle", 6) == 0)
+		mode = SWITCH_TOGGLE;
+	else if (len == 4 && strncmp(args, "open", 4) == 0)
+		mode = SWITCH_OPEN;
+	else if (len == 5 && strncmp(args, "close", 5) == 0)
+		mode = SWITCH_CLOSE;
+	else
+		return false;
+	args += len;
+
+	int index = addSwitch(level, xz[0], xz[1], mode);
+	while (!restIsBlank(args)) {
+		int t[2];
+		if (!readInts(&args, t, 2) || !onBoard(level, t[0], t[1]))
+			return false;
+		addSwitchTarget(level, index, t[0], t[1]);
+	}
+	return true;
+}
+
+static bool parseSplit (Level &level, const char *args)
+{
+	int v[12];
+	if (!readInts(&args, v, 12) || !restIsBlank(args))
+		return false;
+	for (int i = 0; i < 12; i += 2)
+		if (!onBoard(level, v[i], v[i+1]))
+			return false;
+	addSplit(level, v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], v[9], v[10], v[11]);
+	return true;
+}
+
+bool parseLevelPack (const char *text, size_t length, std::vector<Level> &levels, std::string &error)
+{
+	levels.clear();
+	const char *p = text, *end = text + length;
+	Level *level = NULL;
+	int line = 0;
+	int gridRow = -1;	// next grid row to read, -1 outside a grid
+	bool gridDone = false;
+
+	while (p < end) {
+		const char *eol = (const char *)memchr(p, '\n', end - p);
+		if (!eol)
+			eol = end;
+		std::string s(p, eol);
+		p = eol + 1;
+		line++;
+
+		size_t cut = s.find('#');
+		if (cut != std::string::npos)
+			s.erase(cut);
+		size_t first = s.find_first_not_of(" \t\r");
+		if (first == std::string::npos)
+			continue;
+		s.erase(0, first);
+		s.erase(s.find_last_not_of(" \t\r") + 1);
+
+		if (gridRow >= 0) {
+			if ((int)s.size() != level->cols || s.find_first_not_of("0123456789") != std::string::npos)
+				return fail(error, line, "grid row needs one digit per column");
+			for (int x = 0; x < level->cols; x++)
+				setTile(*level, x, gridRow, s[x] - '0');
+			if (++gridRow == level->rows) {
+				gridRow = -1;
+				gridDone = true;
+			}
+			continue;
+		}
+
+		size_t split = s.find_first_of(" \t");
+		std::string word = s.substr(0, split);
+		const char *args = s.c_str() + (split == std::string::npos ? s.size() : split);
+
+		if (word == "level") {
+			if (level && !gridDone)
+				return fail(error, line, "previous level has no grid");
+			levels.push_back(Level());
+			level = &levels.back();
+			resetLevel(*level, 0, 0);
+			gridDone = false;
+			continue;
+		}
+		if (!level)
+			return fail(error, line, "expected 'level'");
+
+		int v[2];
+		if (word == "size") {
+			if (level->cols || !readInts(&args, v, 2) || !restIsBlank(args) || v[0] < 1 || v[1] < 1)
+				return fail(error, line, "bad size");
+			if (v[0] > LEVEL_MAX_SIDE || v[1] > LEVEL_MAX_SIDE)
+				return fail(error, line, "board too large: cols and rows must be at most 2048");
+			resetLevel(*level, v[0], v[1]);
+			continue;
+		}
+		if (!level->cols)
+			return fail(error, line, "'size' must come first");
+
+		if (word == "start") {
+			if (!readInts(&args, v, 2) || !restIsBlank(args) || !onBoard(*level, v[0], v[1]))
+				return fail(error, line, "bad start");
+			level->startX = v[0];
+			level->startZ = v[1];
+		}
+		else if (word == "camera") {
+			char *after;
+			level->cameraX = strtof(args, &after);
+			level->cameraZ = strtof(after, &after);
+			if (!restIsBlank(after))
+				return fail(error, line, "bad camera");
+		}
+		else if (word == "switch") {
+			if (level->switches.size() >= 32 || !parseSwitch(*level, args))
+				return fail(error, line, "bad switch");
+		}
+		else if (word == "split") {
+			if (!parseSplit(*level, args))
+				return fail(error, line, "bad split");
+		}
+		else if (word == "grid") {
+			if (gridDone)
+				return fail(error, line, "second grid");
+			gridRow = 0;
+		}
+		else
+			return fail(error, line, "unknown keyword");
+	}
+
+	if (gridRow >= 0)
+		return fail(error, line, "grid is cut short");
+	if (level && !gridDone)
+		return fail(error, line, "last level has no grid");
+	for (size_t i = 0; i < levels.size(); i++)
+		buildTransitions(levels[i]);
+	return true;
+}
+
+bool loadLevelPack (const char *path, std::vector<Level> &levels, std::string &error)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f) {
+		error = std::string("cannot open ") + path;
+		return false;
+	}
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	std::vector<char> text(size > 0 ? size : 0);
+	bool ok = size >= 0 && fread(text.data(), 1, text.size(), f) == text.size();
+	fclose(f);
+	if (!ok) {
+		error = std::string("cannot read ") + path;
+		return false;
+	}
+	return parseLevelPack(text.data(), text.size(), levels, error);
+}
+
+static const char *switchModeName (int mode)
+{
+	return mode == SWITCH_OPEN ? "open" : mode == SWITCH_CLOSE ? "close" : "toggle";
+}
+
+void writeLevel (FILE *out, const Level &level, int number)
+{
+	fprintf(out, "level %d\n", number);
+	fprintf(out, "size %d %d\n", level.cols, level.rows);
+	fprintf(out, "start %d %d\n", level.startX, level.startZ);
+	if (level.cameraX || level.cameraZ)
+		fprintf(out, "camera %g %g\n", level.cameraX, level.cameraZ);
+	for (size_t i = 0; i < level.switches.size(); i++) {
+		const SwitchBinding &sw = level.switches[i];
+		fprintf(out, "switch %d %d %s", sw.x, sw.z, switchModeName(sw.mode));
+		for (int cell = 0; cell < level.rows*level.cols; cell++)
+			if (sw.targets.test(cell))
+				fprintf(out, " %d %d", cell % level.cols, cell / level.cols);
+		fputc('\n', out);
+	}
+	for (size_t i = 0; i < level.splits.size(); i++) {
+		const SplitBinding &sp = level.splits[i];
+		fprintf(out, "split %d %d %d %d %d %d %d %d %d %d %d %d\n", sp.x, sp.z, sp.x1, sp.z1, sp.x2, sp.z2,
+			sp.handoffX, sp.handoffZ, sp.mergeX1, sp.mergeZ1, sp.mergeX2, sp.mergeZ2);
+	}
+	fprintf(out, "grid\n");
+	BlockState off = startState(level);
+	for (int z = 0; z < level.rows; z++) {
+		for (int x = 0; x < level.cols; x++)
+			fputc('0' + tileAt(level, off, x, z), out);
+		fputc('\n', out);
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef LEVELFILE_H
+#define LEVELFILE_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "bloxorz.h"
+
+/*
+ * Text level packs. A pack is any number of levels, each of the form
+ *
+ *   level 1
+ *   size 15 10              cols rows, at most LEVEL_MAX_SIDE each
+ *   start 1 3               x z of the standing block
+ *   camera 0 0              offset added to the follow cameras (optional)
+ *   switch 2 4 toggle 4 6 5 6
+ *                           x z toggle|open|close, then the x z of every
+ *                           cell it flips
+ *   split 4 5 10 8 10 2 12 5 11 5 12 5
+ *                           x z, half 1 and half 2 landing cells, handoff
+ *                           cell, merge cells of half 1 and half 2
+ *   grid                    followed by rows lines of cols TILE_* digits
+ *   000000000000000
+ *   ...
+ *
+ * '#' starts a comment. Cells a switch flips are stored in their
+ * switched-off state.
+ */
+
+#define DEFAULT_LEVEL_PACK "levels.txt"	// the stages the game plays, next to the shaders
+
+/* Parses a whole pack held in memory; error names the offending line */
+bool parseLevelPack (const char *text, size_t length, std::vector<Level> &levels, std::string &error);
+
+/* Reads the file in one go and parses it */
+bool loadLevelPack (const char *path, std::vector<Level> &levels, std::string &error);
+
+void writeLevel (FILE *out, const Level &level, int number);
+
+#endif
@@ -0,0 +1,198 @@
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "levelpack.h"
+
+bool LevelPackFile::open (const char *path, std::string &error)
+{
+	close();
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0) {
+		error = std::string("cannot open ") + path;
+		return false;
+	}
+	struct stat st;
+	void *map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(PackHeader))
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED) {
+		error = std::string("cannot map ") + path;
+		return false;
+	}
+
+	base = (const uint8_t *)map;
+	size = st.st_size;
+	const PackHeader *h = (const PackHeader *)base;
+	if (memcmp(h->magic, LEVEL_PACK_MAGIC, 8) != 0 ||
+	    sizeof(PackHeader) + (uint64_t)h->count*sizeof(uint64_t) > size) {
+		close();
+		error = std::string(path) + " is not a level pack";
+		return false;
+	}
+	return true;
+}
+
+void LevelPackFile::close ()
+{
+	if (base)
+		munmap((void *)base, size);
+	base = NULL;
+	size = 0;
+}
+
+bool LevelPackFile::read (size_t i, Level &level) const
+{
+	if (i >= count())
+		return false;
+	uint64_t at = ((const uint64_t *)(base + sizeof(PackHeader)))[i];
+	if (at % 8 || at > size || size - at < sizeof(PackRecord))
+		return false;
+
+	// writeLevelPack() refuses what is checked here, so this is corruption
+	const PackRecord *r = (const PackRecord *)(base + at);
+	int cols = r->cols, rows = r->rows, cells = cols*rows;
+	uint64_t bytes = sizeof(PackRecord) + r->switchCount*sizeof(PackSwitch) +
+		r->targetCount*2*sizeof(uint16_t) + r->splitCount*sizeof(PackSplit) + cells;
+	if (!cells || cols > LEVEL_MAX_SIDE || rows > LEVEL_MAX_SIDE ||
+	    r->switchCount > 32 || bytes > size - at)
+		return false;
+	const PackSwitch *sw = (const PackSwitch *)(r + 1);
+	const uint16_t *targets = (const uint16_t *)(sw + r->switchCount);
+	const PackSplit *sp = (const PackSplit *)(targets + 2*r->targetCount);
+	const uint8_t *grid = (const uint8_t *)(sp + r->splitCount);
+
+	// resetLevel() would free the switch targets; refill in place instead
+	level.cols = cols;
+	level.rows = rows;
+	for (int p = 0; p < PLANE_COUNT; p++)
+		level.planes[p].reset(cells);
+	level.bridges.reset(cells);
+	level.startX = r->startX;
+	level.startZ = r->startZ;
+	level.cameraX = r->cameraX;
+	level.cameraZ = r->cameraZ;
+	if (level.startX >= cols || level.startZ >= rows)
+		return false;
+
+	level.switches.resize(r->switchCount);
+	uint32_t t = 0;
+	for (int k = 0; k < r->switchCount; k++) {
+		SwitchBinding &b = level.switches[k];
+		b.x = sw[k].x;
+		b.z = sw[k].z;
+		b.mode = sw[k].mode;
+		b.targets.reset(cells);
+		if (b.x >= cols || b.z >= rows || t + sw[k].targets > r->targetCount)
+			return false;
+		for (int n = 0; n < sw[k].targets; n++, t++) {
+			int x = targets[2*t], z = targets[2*t + 1];
+			if (x >= cols || z >= rows)
+				return false;
+			b.targets.set(z*cols + x);
+			level.bridges.set(z*cols + x);
+		}
+	}
+
+	level.splits.resize(r->splitCount);
+	for (int k = 0; k < r->splitCount; k++) {
+		const uint16_t *v = sp[k].v;
+		for (int n = 0; n < 12; n += 2)
+			if (v[n] >= cols || v[n+1] >= rows)
+				return false;
+		SplitBinding b = { v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], v[9], v[10], v[11] };
+		level.splits[k] = b;
+	}
+
+	for (int z = 0; z < rows; z++)
+		for (int x = 0; x < cols; x++)
+			setTile(level, x, z, grid[z*cols + x]);
+	level.transitions.clear();
+	return true;
+}
+
+template <class T>
+static void append (std::vector<uint8_t> &out, const T &value)
+{
+	const uint8_t *p = (const uint8_t *)&value;
+	out.insert(out.end(), p, p + sizeof(T));
+}
+
+bool writeLevelPack (const char *path, const std::vector<Level> &levels, std::string &error)
+{
+	std::vector<uint8_t> records;
+	std::vector<uint64_t> offsets;
+	uint64_t first = sizeof(PackHeader) + levels.size()*sizeof(uint64_t);
+
+	for (size_t i = 0; i < levels.size(); i++) {
+		const Level &level = levels[i];
+		const char *why = level.cols < 1 || level.rows < 1 ? "has no cells" :
+			level.cols > LEVEL_MAX_SIDE || level.rows > LEVEL_MAX_SIDE ? "is too large: cols and rows must be at most 2048" :
+			level.switches.size() > 32 ? "has more than 32 switches" : NULL;
+		if (why) {
+			char buf[128];
+			snprintf(buf, sizeof buf, "level %d %s", (int)i + 1, why);
+			error = buf;
+			return false;
+		}
+		int cells = level.rows*level.cols;
+		records.resize((records.size() + 7) & ~(size_t)7);
+		offsets.push_back(first + records.size());
+
+		std::vector<uint16_t> targets;
+		std::vector<PackSwitch> switches;
+		for (size_t k = 0; k < level.switches.size(); k++) {
+			const SwitchBinding &b = level.switches[k];
+			PackSwitch s = { (uint16_t)b.x, (uint16_t)b.z, (uint16_t)b.mode, 0 };
+			for (int cell = 0; cell < cells; cell++)
+				if (b.targets.test(cell)) {
+					targets.push_back(cell % level.cols);
+					targets.push_back(cell / level.cols);
+					s.targets++;
+				}
+			switches.push_back(s);
+		}
+
+		PackRecord r = { (uint16_t)level.cols, (uint16_t)level.rows, (uint16_t)level.startX, (uint16_t)level.startZ,
+			level.cameraX, level.cameraZ, (uint16_t)switches.size(), (uint16_t)level.splits.size(),
+			(uint32_t)(targets.size() / 2) };
+		append(records, r);
+		for (size_t k = 0; k < switches.size(); k++)
+			append(records, switches[k]);
+		for (size_t k = 0; k < targets.size(); k++)
+			append(records, targets[k]);
+		for (size_t k = 0; k < level.splits.size(); k++) {
+			const SplitBinding &b = level.splits[k];
+			PackSplit s = {{ (uint16_t)b.x, (uint16_t)b.z, (uint16_t)b.x1, (uint16_t)b.z1, (uint16_t)b.x2, (uint16_t)b.z2,
+				(uint16_t)b.handoffX, (uint16_t)b.handoffZ, (uint16_t)b.mergeX1, (uint16_t)b.mergeZ1,
+				(uint16_t)b.mergeX2, (uint16_t)b.mergeZ2 }};
+			append(records, s);
+		}
+		BlockState off = startState(level);
+		for (int z = 0; z < level.rows; z++)
+			for (int x = 0; x < level.cols; x++)
+				records.push_back(tileAt(level, off, x, z));
+	}
+
+	PackHeader h;
+	memcpy(h.magic, LEVEL_PACK_MAGIC, 8);
+	h.count = levels.size();
+	h.reserved = 0;
+
+	FILE *f = fopen(path, "wb");
+	if (!f) {
+		error = std::string("cannot write ") + path;
+		return false;
+	}
+	bool ok = fwrite(&h, sizeof h, 1, f) == 1 &&
+		(offsets.empty() || fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), f) == offsets.size()) &&
+		(records.empty() || fwrite(records.data(), 1, records.size(), f) == records.size());
+	if (fclose(f) != 0 || !ok) {
+		error = std::string("cannot write ") + path;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,74 @@
+#ifndef LEVELPACK_H
+#define LEVELPACK_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "bloxorz.h"
+
+/*
+ * Binary level packs, mapped read-only so level n is found with one
+ * index lookup and decoded straight from the mapping. Native (little)
+ * endian:
+ *   PackHeader
+ *   uint64_t offsets[count]	byte offset of each level record
+ *   per level, 8-byte aligned:
+ *     PackRecord
+ *     PackSwitch switches[switchCount]
+ *     uint16_t targets[2*targetCount]	x z pairs, in switch order
+ *     PackSplit splits[splitCount]
+ *     uint8_t grid[rows*cols]		TILE_* values, switches off
+ */
+#define LEVEL_PACK_MAGIC "BLXPACK1"
+#define DEFAULT_BINARY_PACK "levels.pack"	// built from DEFAULT_LEVEL_PACK by make
+
+struct PackHeader {
+	char magic[8];
+	uint32_t count;
+	uint32_t reserved;
+};
+
+struct PackRecord {
+	uint16_t cols, rows;
+	uint16_t startX, startZ;
+	float cameraX, cameraZ;
+	uint16_t switchCount, splitCount;
+	uint32_t targetCount;
+};
+
+struct PackSwitch {
+	uint16_t x, z, mode, targets;
+};
+
+struct PackSplit {
+	uint16_t v[12];		// same order as the "split" line of a text pack
+};
+
+class LevelPackFile {
+public:
+	LevelPackFile () : base(NULL), size(0) {}
+	~LevelPackFile () { close(); }
+
+	bool open (const char *path, std::string &error);
+	void close ();
+	bool isOpen () const { return base != NULL; }
+	size_t count () const { return base ? ((const PackHeader *)base)->count : 0; }
+
+	/* Decodes level i (from 0) into level. Storage already in level is
+	   reused, so stepping through a pack does not allocate once the
+	   biggest level has been seen. The transition table is left empty:
+	   step() plays on the full rules without it, and a caller about to
+	   search the level runs buildTransitions() itself. */
+	bool read (size_t i, Level &level) const;
+
+private:
+	const uint8_t *base;
+	size_t size;
+
+	LevelPackFile (const LevelPackFile &);
+	void operator= (const LevelPackFile &);
+};
+
+bool writeLevelPack (const char *path, const std::vector<Level> &levels, std::string &error);
+
+#endif
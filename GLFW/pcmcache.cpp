@@ -0,0 +1,150 @@
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <mpg123.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "pcmcache.h"
+
+/* Whole clip to PCM, converted to the wanted format by mpg123 */
+static bool decodeClip (mpg123_handle *mh, const char *path, std::vector<int16_t> &samples, std::string &error)
+{
+	if (mpg123_open(mh, path) != MPG123_OK) {
+		error = std::string("cannot decode ") + path;
+		return false;
+	}
+	samples.clear();
+	unsigned char buffer[16384];
+	size_t done;
+	int err;
+	do {
+		err = mpg123_read(mh, buffer, sizeof buffer, &done);
+		samples.insert(samples.end(), (const int16_t *)buffer, (const int16_t *)(buffer + done));
+	} while (err == MPG123_OK || err == MPG123_NEW_FORMAT);
+	mpg123_close(mh);
+	if (err != MPG123_DONE) {
+		error = std::string("cannot decode ") + path;
+		return false;
+	}
+	return true;
+}
+
+bool PcmCache::map (const char *path)
+{
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	void *m = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(PcmHeader))
+		m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (m == MAP_FAILED)
+		return false;
+	base = (const uint8_t *)m;
+	size = st.st_size;
+	return true;
+}
+
+void PcmCache::unmap ()
+{
+	if (base)
+		munmap((void *)base, size);
+	base = NULL;
+	size = 0;
+}
+
+/* Written beside the old cache and renamed over it, so a reader never
+   sees half a file and the old mapping stays valid */
+static bool writeCache (const char *path, const std::vector<PcmRecord> &records, const std::vector<PcmClip> &clips, int rate, int channels)
+{
+	PcmHeader h;
+	memcpy(h.magic, PCM_CACHE_MAGIC, 8);
+	h.count = records.size();
+	h.rate = rate;
+	h.channels = channels;
+	h.reserved = 0;
+
+	std::vector<PcmRecord> out(records);
+	uint64_t at = sizeof h + out.size()*sizeof(PcmRecord);
+	for (size_t i = 0; i < out.size(); i++) {
+		at = (at + 7) & ~(uint64_t)7;
+		out[i].offset = at;
+		out[i].samples = clips[i].count;
+		at += clips[i].count*sizeof(int16_t);
+	}
+
+	std::string temp = std::string(path) + ".tmp";
+	FILE *f = fopen(temp.c_str(), "wb");
+	if (!f)
+		return false;
+	bool ok = fwrite(&h, sizeof h, 1, f) == 1 && fwrite(&out[0], sizeof(PcmRecord), out.size(), f) == out.size();
+	static const char zeros[8] = { 0 };
+	for (size_t i = 0; i < out.size() && ok; i++) {
+		long pad = out[i].offset - ftell(f);
+		ok = fwrite(zeros, 1, pad, f) == (size_t)pad &&
+			fwrite(clips[i].samples, sizeof(int16_t), clips[i].count, f) == clips[i].count;
+	}
+	if (fclose(f) != 0 || !ok || rename(temp.c_str(), path) != 0) {
+		remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool PcmCache::load (const char *cachePath, const char *const *sources, int count, int rate, int channels, std::string &error)
+{
+	unmap();
+	clips.assign(count, PcmClip());
+	decoded.assign(count, std::vector<int16_t>());
+	decodedCount = 0;
+
+	const PcmHeader *h = map(cachePath) ? (const PcmHeader *)base : NULL;
+	const PcmRecord *cached = h ? (const PcmRecord *)(h + 1) : NULL;
+	if (h && (memcmp(h->magic, PCM_CACHE_MAGIC, 8) != 0 || h->count != (uint32_t)count ||
+	    h->rate != (uint32_t)rate || h->channels != (uint32_t)channels ||
+	    sizeof(PcmHeader) + (uint64_t)count*sizeof(PcmRecord) > size))
+		cached = NULL;
+
+	std::vector<PcmRecord> records(count);
+	mpg123_handle *mh = NULL;
+	bool ok = true;
+	for (int i = 0; i < count && ok; i++) {
+		struct stat st;
+		if (stat(sources[i], &st) != 0) {
+			error = std::string("cannot open ") + sources[i];
+			ok = false;
+			break;
+		}
+		records[i].sourceSize = st.st_size;
+		records[i].sourceTime = st.st_mtime;
+		if (cached && cached[i].sourceSize == records[i].sourceSize && cached[i].sourceTime == records[i].sourceTime &&
+		    cached[i].offset % 8 == 0 && cached[i].offset + cached[i].samples*sizeof(int16_t) <= size) {
+			clips[i].samples = (const int16_t *)(base + cached[i].offset);
+			clips[i].count = cached[i].samples;
+			continue;
+		}
+
+		if (!mh) {
+			mpg123_init();
+			if (!(mh = mpg123_new(NULL, NULL))) {
+				error = "cannot start mpg123";
+				ok = false;
+				break;
+			}
+			mpg123_format_none(mh);
+			mpg123_format(mh, rate, channels == 1 ? MPG123_MONO : MPG123_STEREO, MPG123_ENC_SIGNED_16);
+		}
+		ok = decodeClip(mh, sources[i], decoded[i], error);
+		clips[i].samples = decoded[i].empty() ? NULL : &decoded[i][0];
+		clips[i].count = decoded[i].size();
+		decodedCount++;
+	}
+	if (mh)
+		mpg123_delete(mh);
+
+	if (ok && decodedCount && !writeCache(cachePath, records, clips, rate, channels))
+		fprintf(stderr, "Warning: cannot write %s\n", cachePath);
+	return ok;
+}
@@ -0,0 +1,68 @@
+#ifndef PCMCACHE_H
+#define PCMCACHE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+ * Sound clips decoded once into resident PCM, with a pre-decoded copy
+ * kept on disk so a warm start maps it instead of decoding. The disk
+ * cache is rebuilt whenever a source file's size or time changes.
+ * Native (little) endian:
+ *   PcmHeader
+ *   PcmRecord records[count]	one per source, in the order given
+ *   int16_t samples[]		each clip 8-byte aligned, interleaved
+ */
+#define PCM_CACHE_MAGIC "BLXPCM01"
+#define DEFAULT_PCM_CACHE "sounds.pcm"	// next to the mp3 files, written on first run
+
+struct PcmHeader {
+	char magic[8];
+	uint32_t count;
+	uint32_t rate;
+	uint32_t channels;
+	uint32_t reserved;
+};
+
+struct PcmRecord {
+	uint64_t sourceSize;
+	int64_t sourceTime;	// modification time, seconds
+	uint64_t offset;	// byte offset of the samples
+	uint64_t samples;
+};
+
+struct PcmClip {
+	const int16_t *samples;
+	size_t count;		// samples, not frames
+};
+
+class PcmCache {
+public:
+	PcmCache () : decodedCount(0), base(NULL), size(0) {}
+	~PcmCache () { unmap(); }
+
+	/* Makes every source available as a clip at rate and channels,
+	   from the disk cache where it is current and decoded otherwise.
+	   The disk cache is rewritten if anything had to be decoded; a
+	   failed write only costs the next start its speed. */
+	bool load (const char *cachePath, const char *const *sources, int count, int rate, int channels, std::string &error);
+
+	const PcmClip &clip (int i) const { return clips[i]; }
+
+	int decodedCount;	// clips the last load() had to decode
+
+private:
+	const uint8_t *base;
+	size_t size;
+	std::vector<PcmClip> clips;
+	std::vector<std::vector<int16_t> > decoded;	// clips the mapping could not supply
+
+	bool map (const char *path);
+	void unmap ();
+
+	PcmCache (const PcmCache &);
+	void operator= (const PcmCache &);
+};
+
+#endif
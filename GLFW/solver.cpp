@@ -0,0 +1,475 @@
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+#include "solver.h"
+
+char moveName (int move)
+{
+	return "UDLR"[move];
+}
+
+static size_t hashSlot (uint64_t key, size_t mask)
+{
+	// Fibonacci hashing spreads the packed cell bits over the whole table
+	return (size_t)((key * 0x9e3779b97f4a7c15ull) >> 20) & mask;
+}
+
+/**************
+ * StateTable *
+ **************/
+const uint64_t StateTable::EMPTY;
+
+size_t StateTable::slot (uint64_t key) const
+{
+	size_t mask = keys.size() - 1;
+	size_t i = hashSlot(key, mask);
+	while (keys[i] != EMPTY && keys[i] != key)
+		i = (i + 1) & mask;
+	return i;
+}
+
+void StateTable::resize (size_t slots)
+{
+	std::vector<uint64_t> oldKeys;
+	std::vector<uint32_t> oldValues;
+	oldKeys.swap(keys);
+	oldValues.swap(values);
+	keys.assign(slots, EMPTY);
+	values.assign(slots, 0);
+	for (size_t i = 0; i < oldKeys.size(); i++) {
+		if (oldKeys[i] == EMPTY)
+			continue;
+		size_t j = slot(oldKeys[i]);
+		keys[j] = oldKeys[i];
+		values[j] = oldValues[i];
+	}
+}
+
+long StateTable::find (uint64_t key) const
+{
+	size_t i = slot(key);
+	return keys[i] == EMPTY ? -1 : (long)values[i];
+}
+
+uint32_t StateTable::insert (uint64_t key, uint32_t value)
+{
+	size_t i = slot(key);
+	if (keys[i] == key)
+		return values[i];
+	if (2*(used + 1) > keys.size()) {
+		resize(2*keys.size());
+		i = slot(key);
+	}
+	keys[i] = key;
+	values[i] = value;
+	used++;
+	return value;
+}
+
+/******************
+ * SharedStateSet *
+ ******************/
+/* Insert-only set of state keys that any number of threads can fill at
+   once. Only reserve() grows it, and it must not overlap insert(). */
+class SharedStateSet {
+public:
+	SharedStateSet () : keys(NULL), slots(0) { reserve(512); }
+	~SharedStateSet () { delete [] keys; }
+
+	/* Room for count keys at no more than 50% load */
+	void reserve (size_t count);
+	/* True when key was not in the set yet */
+	bool insert (uint64_t key);
+	size_t bytes () const { return slots*sizeof(uint64_t); }
+
+private:
+	static const uint64_t EMPTY = ~(uint64_t)0;
+
+	std::atomic<uint64_t> *keys;
+	size_t slots;
+
+	SharedStateSet (const SharedStateSet &);
+	void operator= (const SharedStateSet &);
+};
+
+const uint64_t SharedStateSet::EMPTY;
+
+void SharedStateSet::reserve (size_t count)
+{
+	if (2*count <= slots)
+		return;
+	size_t grown = slots ? slots : 1024;
+	while (2*count > grown)
+		grown *= 2;
+
+	std::atomic<uint64_t> *old = keys;
+	size_t oldSlots = slots;
+	keys = new std::atomic<uint64_t>[grown];
+	slots = grown;
+	for (size_t i = 0; i < slots; i++)
+		keys[i].store(EMPTY, std::memory_order_relaxed);
+	for (size_t i = 0; i < oldSlots; i++) {
+		uint64_t key = old[i].load(std::memory_order_relaxed);
+		if (key != EMPTY)
+			insert(key);
+	}
+	delete [] old;
+}
+
+bool SharedStateSet::insert (uint64_t key)
+{
+	size_t mask = slots - 1;
+	for (size_t i = hashSlot(key, mask); ; i = (i + 1) & mask) {
+		uint64_t seen = keys[i].load(std::memory_order_relaxed);
+		if (seen == EMPTY && keys[i].compare_exchange_strong(seen, key, std::memory_order_relaxed))
+			return true;
+		// seen now holds whatever won the slot
+		if (seen == key)
+			return false;
+	}
+}
+
+/***********
+ * Search *
+ ***********/
+struct Node {
+	uint64_t key;
+	uint32_t parent;
+	uint32_t g;
+	int move;
+};
+
+static void reset (Solution &sol)
+{
+	sol.solved = false;
+	sol.moves.clear();
+	sol.explored = 0;
+	sol.peakBytes = 0;
+}
+
+static void tracePath (const std::vector<Node> &nodes, uint32_t goal, Solution &sol)
+{
+	for (uint32_t i = goal; nodes[i].move >= 0; i = nodes[i].parent)
+		sol.moves.insert(sol.moves.begin(), moveName(nodes[i].move));
+	sol.solved = true;
+}
+
+static Node startNode (const Level &level)
+{
+	BlockState start = startState(level);
+	Node n = { stateKey(packState(level, start), start.switches), 0, 0, -1 };
+	return n;
+}
+
+bool solveBFS (const Level &level, Solution &sol)
+{
+	reset(sol);
+	if (!canPack(level))
+		return false;
+
+	StateTable seen;
+	std::vector<Node> nodes;	// doubles as the FIFO frontier
+	nodes.push_back(startNode(level));
+	seen.insert(nodes[0].key, 0);
+
+	for (size_t head = 0; head < nodes.size(); head++) {
+		sol.explored++;
+		for (int move = 0; move < 4; move++) {
+			uint64_t key = nodes[head].key;
+			unsigned switches = key >> 32;
+			PackedState next = stepPacked(level, (PackedState)key, switches, move);
+			if (packedFell(next))
+				continue;
+			uint64_t nextKey = stateKey(next, switches);
+			if (seen.find(nextKey) >= 0)
+				continue;
+			Node n = { nextKey, (uint32_t)head, nodes[head].g + 1, move };
+			seen.insert(nextKey, nodes.size());
+			nodes.push_back(n);
+			if (packedWon(next)) {
+				tracePath(nodes, nodes.size() - 1, sol);
+				break;
+			}
+		}
+		if (sol.solved)
+			break;
+	}
+	sol.peakBytes = seen.bytes() + nodes.capacity()*sizeof(Node);
+	return sol.solved;
+}
+
+/* Frontier nodes are handed out in chunks from a shared cursor, so a
+   thread that finishes early keeps taking chunks the others have not
+   reached. New nodes go to a per-thread buffer until the depth is done. */
+#define PARALLEL_CHUNK 256
+#define PARALLEL_MIN_FRONTIER 4096	// smaller depths run on one thread
+
+struct ExpandJob {
+	const Level *level;
+	const std::vector<Node> *nodes;
+	SharedStateSet *seen;
+	std::vector<std::vector<Node> > found;
+	std::atomic<size_t> cursor;
+	size_t end;
+	std::atomic<bool> won;
+};
+
+static void expandChunks (ExpandJob *job, int thread)
+{
+	const std::vector<Node> &nodes = *job->nodes;
+	std::vector<Node> &found = job->found[thread];
+	while (!job->won.load(std::memory_order_relaxed)) {
+		size_t first = job->cursor.fetch_add(PARALLEL_CHUNK);
+		if (first >= job->end)
+			break;
+		size_t last = first + PARALLEL_CHUNK < job->end ? first + PARALLEL_CHUNK : job->end;
+		for (size_t i = first; i < last; i++) {
+			for (int move = 0; move < 4; move++) {
+				unsigned switches = nodes[i].key >> 32;
+				PackedState next = stepPacked(*job->level, (PackedState)nodes[i].key, switches, move);
+				if (packedFell(next))
+					continue;
+				uint64_t nextKey = stateKey(next, switches);
+				if (!job->seen->insert(nextKey))
+					continue;
+				Node n = { nextKey, (uint32_t)i, nodes[i].g + 1, move };
+				found.push_back(n);
+				if (packedWon(next))
+					job->won.store(true);
+			}
+		}
+	}
+}
+
+bool solveParallelBFS (const Level &level, Solution &sol, int threads)
+{
+	reset(sol);
+	if (!canPack(level))
+		return false;
+	if (threads <= 0)
+		threads = std::thread::hardware_concurrency();
+	if (threads <= 0)
+		threads = 1;
+
+	SharedStateSet seen;
+	std::vector<Node> nodes;
+	nodes.push_back(startNode(level));
+	seen.insert(nodes[0].key);
+
+	ExpandJob job;
+	job.level = &level;
+	job.nodes = &nodes;
+	job.seen = &seen;
+	job.found.resize(threads);
+	job.won = false;
+	size_t foundBytes = 0;
+
+	for (size_t begin = 0, end = 1; begin < end && !sol.solved; ) {
+		// At most 4 new states per frontier node, so no growth mid-depth
+		seen.reserve(nodes.size() + 4*(end - begin));
+		job.cursor = begin;
+		job.end = end;
+
+		int workers = end - begin < PARALLEL_MIN_FRONTIER ? 1 : threads;
+		std::vector<std::thread> pool;
+		for (int t = 1; t < workers; t++)
+			pool.push_back(std::thread(expandChunks, &job, t));
+		expandChunks(&job, 0);
+		for (size_t t = 0; t < pool.size(); t++)
+			pool[t].join();
+		sol.explored += end - begin;
+
+		size_t depthBytes = 0;
+		for (int t = 0; t < workers; t++) {
+			depthBytes += job.found[t].capacity()*sizeof(Node);
+			nodes.insert(nodes.end(), job.found[t].begin(), job.found[t].end());
+			job.found[t].clear();
+		}
+		if (depthBytes > foundBytes)
+			foundBytes = depthBytes;
+		begin = end;
+		end = nodes.size();
+
+		if (job.won)
+			for (size_t i = begin; i < end && !sol.solved; i++)
+				if (packedWon((PackedState)nodes[i].key))
+					tracePath(nodes, i, sol);
+	}
+	sol.peakBytes = seen.bytes() + nodes.capacity()*sizeof(Node) + foundBytes;
+	return sol.solved;
+}
+
+bool exploreLevel (const Level &level, Reachability &r)
+{
+	r.states = r.deadEnds = 0;
+	r.peakBytes = 0;
+	if (!canPack(level))
+		return false;
+
+	// Forward: number every reachable state and remember its successors
+	const uint32_t NONE = 0xffffffffu;
+	StateTable seen;
+	std::vector<uint64_t> keys(1, startNode(level).key);
+	std::vector<uint32_t> next;	// 4 per state, NONE for falls and won states
+	seen.insert(keys[0], 0);
+	for (size_t i = 0; i < keys.size(); i++) {
+		for (int move = 0; move < 4; move++) {
+			unsigned switches = keys[i] >> 32;
+			PackedState p = stepPacked(level, (PackedState)keys[i], switches, move);
+			if (packedWon((PackedState)keys[i]) || packedFell(p)) {
+				next.push_back(NONE);
+				continue;
+			}
+			uint64_t key = stateKey(p, switches);
+			uint32_t j = seen.insert(key, keys.size());
+			if (j == keys.size())
+				keys.push_back(key);
+			next.push_back(j);
+		}
+	}
+
+	// Backward: predecessor lists in one array, then flood from the wins
+	size_t n = keys.size();
+	std::vector<uint32_t> first(n + 1, 0), prev(next.size());
+	for (size_t e = 0; e < next.size(); e++)
+		if (next[e] != NONE)
+			first[next[e] + 1]++;
+	for (size_t i = 0; i < n; i++)
+		first[i + 1] += first[i];
+	std::vector<uint32_t> fill(first.begin(), first.end() - 1);
+	for (size_t e = 0; e < next.size(); e++)
+		if (next[e] != NONE)
+			prev[fill[next[e]]++] = e / 4;
+
+	std::vector<char> wins(n, 0);
+	std::vector<uint32_t> queue;
+	for (size_t i = 0; i < n; i++)
+		if (packedWon((PackedState)keys[i])) {
+			wins[i] = 1;
+			queue.push_back(i);
+		}
+	for (size_t head = 0; head < queue.size(); head++)
+		for (uint32_t e = first[queue[head]]; e < first[queue[head] + 1]; e++)
+			if (!wins[prev[e]]) {
+				wins[prev[e]] = 1;
+				queue.push_back(prev[e]);
+			}
+
+	r.states = n;
+	for (size_t i = 0; i < n; i++)
+		if (!wins[i])
+			r.deadEnds++;
+	r.peakBytes = seen.bytes() + keys.capacity()*sizeof(uint64_t)
+		+ (next.capacity() + first.capacity() + prev.capacity() + fill.capacity() + queue.capacity())*sizeof(uint32_t)
+		+ wins.capacity();
+	return true;
+}
+
+/* Lower bound on the moves left: a block gains at most 2 cells on a move
+   out of standing and at most 1 on the move back up, so it needs at
+   least distance/1.5 moves to the nearest target. The targets are the
+   goals and the split tiles, since a split tile can carry the block
+   any distance in one move. Split halves get no estimate. */
+static uint32_t rollingDistance (const Level &level, const std::vector<int> &targets, PackedState p)
+{
+	if (packedMode(p) == PACK_SPLIT_1 || packedMode(p) == PACK_SPLIT_2)
+		return 0;
+	BlockState s;
+	unpackState(level, p, s);
+	int xs[2], zs[2];
+	int n = blockCells(s, xs, zs);
+	int best = -1;
+	for (size_t g = 0; g < targets.size(); g++) {
+		int gx = targets[g] % level.cols, gz = targets[g] / level.cols;
+		for (int k = 0; k < n; k++) {
+			int d = abs(xs[k] - gx) + abs(zs[k] - gz);
+			if (best < 0 || d < best)
+				best = d;
+		}
+	}
+	return best < 0 ? 0 : (2*best + 2) / 3;
+}
+
+bool solveAStar (const Level &level, Solution &sol)
+{
+	reset(sol);
+	if (!canPack(level))
+		return false;
+
+	std::vector<int> targets;
+	bool goal = false;
+	for (int cell = 0; cell < level.rows*level.cols; cell++) {
+		if (level.planes[PLANE_GOAL].test(cell))
+			goal = true;
+		else if (!level.planes[PLANE_SPLIT].test(cell))
+			continue;
+		targets.push_back(cell);
+	}
+	if (!goal)
+		return false;
+
+	StateTable seen;
+	std::vector<Node> nodes;
+	nodes.push_back(startNode(level));
+	seen.insert(nodes[0].key, 0);
+
+	/* Bucket queue on f = g + h; each entry remembers the g it was queued
+	   with so entries overtaken by a shorter path are skipped. The
+	   heuristic is admissible but not consistent, so nodes can reopen
+	   and f can drop below the bucket being drained. */
+	std::vector<std::vector<uint64_t> > open(1);
+	size_t queued = 0, openBytes = 0;
+	uint32_t f = rollingDistance(level, targets, (PackedState)nodes[0].key);
+	open.resize(f + 1);
+	open[f].push_back(0);
+	queued++;
+
+	while (queued && !sol.solved) {
+		while (open[f].empty())
+			f++;
+		uint64_t entry = open[f].back();
+		open[f].pop_back();
+		queued--;
+		uint32_t index = (uint32_t)entry;
+		uint32_t g = entry >> 32;
+		if (nodes[index].g != g)
+			continue;
+
+		PackedState p = (PackedState)nodes[index].key;
+		if (packedWon(p)) {
+			tracePath(nodes, index, sol);
+			break;
+		}
+		sol.explored++;
+		for (int move = 0; move < 4; move++) {
+			unsigned switches = nodes[index].key >> 32;
+			PackedState next = stepPacked(level, p, switches, move);
+			if (packedFell(next))
+				continue;
+			uint64_t nextKey = stateKey(next, switches);
+			uint32_t i = seen.insert(nextKey, nodes.size());
+			if (i == nodes.size()) {
+				Node n = { nextKey, index, g + 1, move };
+				nodes.push_back(n);
+			}
+			else if (nodes[i].g > g + 1) {
+				nodes[i].parent = index;
+				nodes[i].g = g + 1;
+				nodes[i].move = move;
+			}
+			else
+				continue;
+			uint32_t nf = g + 1 + rollingDistance(level, targets, next);
+			if (nf >= open.size())
+				open.resize(nf + 1);
+			open[nf].push_back((uint64_t)(g + 1) << 32 | i);
+			queued++;
+			if (nf < f)
+				f = nf;
+		}
+		if (queued*sizeof(uint64_t) > openBytes)
+			openBytes = queued*sizeof(uint64_t);
+	}
+	sol.peakBytes = seen.bytes() + nodes.capacity()*sizeof(Node) + openBytes;
+	return sol.solved;
+}
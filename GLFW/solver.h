@@ -0,0 +1,71 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <string>
+#include <vector>
+#include "bloxorz.h"
+
+struct Solution {
+	bool solved;
+	std::string moves;	// one of "UDLR" per move, in Move order
+	long explored;		// states taken off the frontier
+	size_t peakBytes;	// largest footprint of the search's own tables
+};
+
+/* Search key: packed pose in the low word, switch bits in the high word */
+static inline uint64_t stateKey (PackedState p, unsigned switches)
+{
+	return (uint64_t)switches << 32 | p;
+}
+
+/* Open-addressing (linear probing) map from a state key to a node index.
+   Grows at 50% load. */
+class StateTable {
+public:
+	StateTable () : used(0) { resize(1024); }
+
+	/* Index stored for key, or -1 */
+	long find (uint64_t key) const;
+	/* Stores value for key unless it is already there; returns the index
+	   that ends up stored */
+	uint32_t insert (uint64_t key, uint32_t value);
+	size_t size () const { return used; }
+	size_t bytes () const { return keys.capacity()*sizeof(uint64_t) + values.capacity()*sizeof(uint32_t); }
+
+private:
+	static const uint64_t EMPTY = ~(uint64_t)0;	// not a valid key: fallen bit and mode 7
+
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> values;
+	size_t used;
+
+	void resize (size_t slots);
+	size_t slot (uint64_t key) const;
+};
+
+/* Shortest solution by breadth-first search over the real game rules */
+bool solveBFS (const Level &level, Solution &sol);
+
+/* solveBFS() spread over threads, one frontier depth at a time.
+   threads <= 0 uses every core. The move count matches solveBFS() but
+   which of several equally short solutions comes back can vary. */
+bool solveParallelBFS (const Level &level, Solution &sol, int threads);
+
+/* Shortest solution by A*. The heuristic is the Manhattan distance from
+   the nearest block cell to the nearest goal or split tile divided by
+   1.5, the most a rolling block gains per move on average, rounded up. */
+bool solveAStar (const Level &level, Solution &sol);
+
+/* Every state reachable from the start. Dead ends are soft-locks: the
+   block is still on the board but no sequence of moves wins any more. */
+struct Reachability {
+	long states;		// reachable states, won ones included
+	long deadEnds;
+	size_t peakBytes;
+};
+
+bool exploreLevel (const Level &level, Reachability &r);
+
+char moveName (int move);
+
+#endif
@@ -0,0 +1,371 @@
+#include <cstdio>
+#include <cstring>
+#include "bloxorz.h"
+#include "generator.h"
+#include "levelfile.h"
+#include "levelpack.h"
+#include "solver.h"
+
+/*
+ * Headless checks of the rules, solvers and level formats. Run from
+ * this directory (make check), since it reads levels.txt.
+ */
+
+static int failures;
+
+#define CHECK(cond, ...) do { if (!(cond)) { failures++; printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); } } while (0)
+
+/* A split tile four cells left of the start beats eight rolls right to
+   the goal; a heuristic that ignored the teleport found the long way */
+static const char *splitShortcut =
+	"level 1\n"
+	"size 26 3\n"
+	"start 10 1\n"
+	"split 4 1 20 1 21 1 20 1 20 1 21 1\n"
+	"grid\n"
+	"00000000000000000000000000\n"
+	"00117111111111111111114110\n"
+	"00000000000000000000000000\n";
+
+/* The goal is cut off, so every state the block can reach is a dead end */
+static const char *cutOff =
+	"level 1\n"
+	"size 8 1\n"
+	"start 0 0\n"
+	"grid\n"
+	"11111004\n";
+
+static bool parse (const char *text, Level &level)
+{
+	std::vector<Level> levels;
+	std::string error;
+	if (!parseLevelPack(text, strlen(text), levels, error) || levels.size() != 1) {
+		printf("cannot parse a built-in level: %s\n", error.c_str());
+		return false;
+	}
+	level = levels[0];
+	return true;
+}
+
+static bool sameBits (const Bitboard &a, const Bitboard &b)
+{
+	return a.words == b.words;
+}
+
+static bool sameLevel (const Level &a, const Level &b)
+{
+	if (a.rows != b.rows || a.cols != b.cols || a.startX != b.startX || a.startZ != b.startZ ||
+	    a.cameraX != b.cameraX || a.cameraZ != b.cameraZ || !sameBits(a.bridges, b.bridges) ||
+	    a.switches.size() != b.switches.size() || a.splits.size() != b.splits.size())
+		return false;
+	for (int p = 0; p < PLANE_COUNT; p++)
+		if (!sameBits(a.planes[p], b.planes[p]))
+			return false;
+	for (size_t i = 0; i < a.switches.size(); i++) {
+		const SwitchBinding &s = a.switches[i], &t = b.switches[i];
+		if (s.x != t.x || s.z != t.z || s.mode != t.mode || !sameBits(s.targets, t.targets))
+			return false;
+	}
+	for (size_t i = 0; i < a.splits.size(); i++)
+		if (memcmp(&a.splits[i], &b.splits[i], sizeof(SplitBinding)) != 0)
+			return false;
+	return a.transitions == b.transitions;
+}
+
+/* Replays moves with step() and reports whether they win */
+static bool wins (const Level &level, const std::string &moves)
+{
+	BlockState s = startState(level);
+	for (size_t i = 0; i < moves.size(); i++)
+		step(level, s, strchr("UDLR", moves[i]) - "UDLR");
+	return s.status == STATUS_WON;
+}
+
+/* All three solvers agree on the length, and their answers play out */
+static void checkSolvers (const Level &level, const char *name)
+{
+	Solution bfs, parallel, astar;
+	bool solved = solveBFS(level, bfs);
+	CHECK(solveParallelBFS(level, parallel, 4) == solved, "%s: parallel BFS disagrees on solvability", name);
+	CHECK(solveAStar(level, astar) == solved, "%s: A* disagrees on solvability", name);
+	if (!solved)
+		return;
+	CHECK(parallel.moves.size() == bfs.moves.size(), "%s: parallel BFS %s, BFS %s", name, parallel.moves.c_str(), bfs.moves.c_str());
+	CHECK(astar.moves.size() == bfs.moves.size(), "%s: A* %s, BFS %s", name, astar.moves.c_str(), bfs.moves.c_str());
+	CHECK(wins(level, bfs.moves), "%s: BFS answer %s does not win", name, bfs.moves.c_str());
+	CHECK(wins(level, parallel.moves), "%s: parallel BFS answer %s does not win", name, parallel.moves.c_str());
+	CHECK(wins(level, astar.moves), "%s: A* answer %s does not win", name, astar.moves.c_str());
+}
+
+/* Along the solution, packing round-trips and stepPacked() follows step() */
+static void checkPacking (const Level &level, const char *name)
+{
+	Solution sol;
+	if (!solveBFS(level, sol))
+		return;
+	BlockState s = startState(level);
+	PackedState p = packState(level, s);
+	unsigned switches = s.switches;
+	for (size_t i = 0; i <= sol.moves.size(); i++) {
+		BlockState u = s;
+		u.x = u.z = u.x2 = u.z2 = -99;
+		unpackState(level, packState(level, s), u);
+		CHECK(u.x == s.x && u.z == s.z && u.orient == s.orient && u.status == s.status, "%s: move %d does not unpack", name, (int)i);
+		if (s.orient == ORIENT_SPLIT)
+			CHECK(u.x2 == s.x2 && u.z2 == s.z2 && u.active == s.active, "%s: move %d loses a half", name, (int)i);
+		CHECK(p == packState(level, s) && switches == s.switches, "%s: stepPacked() and step() part at move %d", name, (int)i);
+		if (i == sol.moves.size())
+			break;
+		int move = strchr("UDLR", sol.moves[i]) - "UDLR";
+		step(level, s, move);
+		p = stepPacked(level, p, switches, move);
+	}
+}
+
+/* Shortest solution of each stage, the "# par" lines of levels.txt */
+static const int stagePar[] = { 7, 17, 22, 24, 35, 30, 12, 24 };
+#define STAGES (int)(sizeof stagePar/sizeof stagePar[0])
+
+static void checkStages ()
+{
+	std::vector<Level> levels;
+	std::string error;
+	if (!loadLevelPack(DEFAULT_LEVEL_PACK, levels, error)) {
+		CHECK(false, "%s", error.c_str());
+		return;
+	}
+	CHECK((int)levels.size() == STAGES, "%d stages", (int)levels.size());
+	for (size_t i = 0; i < levels.size() && (int)i < STAGES; i++) {
+		char name[32];
+		sprintf(name, "stage %d", (int)i + 1);
+		Solution sol;
+		CHECK(solveBFS(levels[i], sol), "%s has no solution", name);
+		CHECK((int)sol.moves.size() == stagePar[i], "%s: %d moves, par is %d", name, (int)sol.moves.size(), stagePar[i]);
+		checkSolvers(levels[i], name);
+		checkPacking(levels[i], name);
+
+		Reachability r;
+		CHECK(exploreLevel(levels[i], r), "%s cannot be explored", name);
+		CHECK(r.states > (long)sol.moves.size() && r.deadEnds < r.states, "%s: %ld states, %ld dead ends", name, r.states, r.deadEnds);
+	}
+}
+
+static void checkSplitShortcut ()
+{
+	Level level;
+	if (!parse(splitShortcut, level)) {
+		failures++;
+		return;
+	}
+	Solution sol;
+	CHECK(solveAStar(level, sol) && sol.moves == "LLLLR", "split shortcut: A* gives %s", sol.moves.c_str());
+	checkSolvers(level, "split shortcut");
+	checkPacking(level, "split shortcut");
+}
+
+static void checkExplore ()
+{
+	Level level;
+	if (!parse(cutOff, level)) {
+		failures++;
+		return;
+	}
+	Solution sol;
+	Reachability r;
+	CHECK(!solveBFS(level, sol), "cut-off level solved as %s", sol.moves.c_str());
+	CHECK(exploreLevel(level, r) && r.states > 1 && r.deadEnds == r.states, "cut-off level: %ld states, %ld dead ends", r.states, r.deadEnds);
+}
+
+static void checkFragile ()
+{
+	Level level;
+	resetLevel(level, 5, 1);
+	for (int x = 0; x < 5; x++)
+		setTile(level, x, 0, x == 3 ? TILE_FRAGILE : TILE_FLOOR);
+	level.startX = 0;
+	level.startZ = 0;
+	buildTransitions(level);
+
+	// Lying across it is safe, standing on it is not
+	BlockState s = startState(level);
+	step(level, s, MOVE_RIGHT);
+	CHECK(s.status == STATUS_PLAYING && tileAt(level, s, 3, 0) == TILE_FRAGILE, "fragile tile gave way under a lying block");
+	int events = step(level, s, MOVE_RIGHT);
+	CHECK(s.status == STATUS_FELL && (events & EVENT_BREAK), "standing on a fragile tile: events %d", events);
+	CHECK(brokenCell(level, s) == 3 && tileAt(level, s, 3, 0) == TILE_EMPTY, "fragile tile still there after breaking");
+}
+
+/* The text parser takes boards up to LEVEL_MAX_SIDE a side, whether
+   or not the solvers can pack them */
+static void checkSizeLimit ()
+{
+	char text[64];
+	std::vector<Level> levels;
+	std::string error;
+	sprintf(text, "level 1\nsize 200 200\n");
+	parseLevelPack(text, strlen(text), levels, error);	// fails later, for want of a grid
+	CHECK(error.find("too large") == std::string::npos, "200x200 rejected: %s", error.c_str());
+	sprintf(text, "level 1\nsize 2048 1\n");
+	parseLevelPack(text, strlen(text), levels, error);
+	CHECK(error.find("too large") == std::string::npos, "2048x1 rejected: %s", error.c_str());
+	sprintf(text, "level 1\nsize 2049 1\n");
+	CHECK(!parseLevelPack(text, strlen(text), levels, error) && error.find("too large") != std::string::npos, "2049x1 accepted");
+
+	// Sizes that overflow int arithmetic, or int itself
+	const char *huge[] = { "2147483647 1", "2147483647 2147483647", "99999999999 1", "-2147483648 -1" };
+	for (size_t k = 0; k < sizeof huge/sizeof huge[0]; k++) {
+		sprintf(text, "level 1\nsize %s\n", huge[k]);
+		CHECK(!parseLevelPack(text, strlen(text), levels, error) && error.find("line 2") != std::string::npos, "size %s accepted", huge[k]);
+	}
+}
+
+static bool writeBytes (const char *path, const std::vector<char> &bytes, size_t count)
+{
+	FILE *f = fopen(path, "wb");
+	if (!f)
+		return false;
+	bool ok = fwrite(bytes.data(), 1, count, f) == count;
+	return fclose(f) == 0 && ok;
+}
+
+/* Text to binary and back gives the same levels; a cut-short file is refused */
+static void checkBinaryPack ()
+{
+	const char *path = "tests.pack";
+	std::vector<Level> levels;
+	std::string error;
+	if (!loadLevelPack(DEFAULT_LEVEL_PACK, levels, error)) {
+		CHECK(false, "%s", error.c_str());
+		return;
+	}
+	Level level;
+	if (parse(splitShortcut, level))
+		levels.push_back(level);
+	CHECK(writeLevelPack(path, levels, error), "%s", error.c_str());
+
+	LevelPackFile pack;
+	CHECK(pack.open(path, error) && pack.count() == levels.size(), "pack holds %d levels", (int)pack.count());
+	for (size_t i = 0; i < pack.count(); i++) {
+		CHECK(pack.read(i, level) && level.transitions.empty(), "level %d read with a transition table", (int)i + 1);
+		buildTransitions(level);
+		CHECK(sameLevel(level, levels[i]), "level %d changes in a binary pack", (int)i + 1);
+	}
+	pack.close();
+
+	std::vector<char> bytes;
+	FILE *f = fopen(path, "rb");
+	if (f) {
+		char buf[4096];
+		size_t n;
+		while ((n = fread(buf, 1, sizeof buf, f)) > 0)
+			bytes.insert(bytes.end(), buf, buf + n);
+		fclose(f);
+	}
+	size_t cuts[] = { bytes.size() - 1, bytes.size()/2, sizeof(PackHeader) + 8, sizeof(PackHeader) - 1 };
+	for (size_t k = 0; k < sizeof cuts/sizeof cuts[0]; k++) {
+		CHECK(writeBytes(path, bytes, cuts[k]), "cannot write %s", path);
+		bool whole = pack.open(path, error);
+		for (size_t i = 0; i < pack.count(); i++)
+			whole = whole && pack.read(i, level);
+		CHECK(!whole, "pack cut to %d of %d bytes still reads", (int)cuts[k], (int)bytes.size());
+		pack.close();
+	}
+	remove(path);
+
+	// At the limits it round-trips, past them it is refused on the way in
+	std::vector<Level> edge(2);
+	resetLevel(edge[0], 200, 200);
+	resetLevel(edge[1], 5, 1);
+	for (int x = 0; x < 5; x++)
+		setTile(edge[1], x, 0, TILE_FLOOR);
+	for (int k = 0; k < 32; k++)
+		addSwitchTarget(edge[1], addSwitch(edge[1], k % 5, 0, SWITCH_TOGGLE), (k + 1) % 5, 0);
+	for (size_t i = 0; i < edge.size(); i++)
+		buildTransitions(edge[i]);
+	CHECK(writeLevelPack(path, edge, error) && pack.open(path, error), "%s", error.c_str());
+	for (size_t i = 0; i < pack.count(); i++) {
+		CHECK(pack.read(i, level), "edge case %d does not read", (int)i + 1);
+		buildTransitions(level);
+		CHECK(sameLevel(level, edge[i]), "edge case %d changes in a binary pack", (int)i + 1);
+	}
+	pack.close();
+
+	std::vector<Level> bad(1);
+	resetLevel(bad[0], LEVEL_MAX_SIDE + 1, 1);
+	CHECK(!writeLevelPack(path, bad, error) && error.find("too large") != std::string::npos, "%dx1 board written", LEVEL_MAX_SIDE + 1);
+	addSwitch(edge[1], 0, 0, SWITCH_TOGGLE);
+	CHECK(!writeLevelPack(path, edge, error) && error.find("switches") != std::string::npos,
+		"33 switches written");
+	remove(path);
+}
+
+/* A board too big for the solvers still loads and plays on the full rules */
+static void checkBigBoard ()
+{
+	std::string text = "level 1\nsize 200 200\nstart 0 0\ngrid\n";
+	for (int z = 0; z < 200; z++)
+		text += std::string(199, '1') + (z == 199 ? "4\n" : "1\n");
+	std::vector<Level> levels;
+	std::string error;
+	if (!parseLevelPack(text.c_str(), text.size(), levels, error)) {
+		CHECK(false, "200x200 board: %s", error.c_str());
+		return;
+	}
+	const Level &level = levels[0];
+	CHECK(!canPack(level) && level.transitions.empty(), "200x200 board packs");
+	BlockState s = startState(level);
+	int events = step(level, s, MOVE_RIGHT) | step(level, s, MOVE_DOWN);
+	CHECK(s.status == STATUS_PLAYING && (events & EVENT_MOVED) && s.orient == ORIENT_LYING_X && s.z == 1,
+		"200x200 board: block at %d %d orient %d", s.x, s.z, s.orient);
+	Solution sol;
+	CHECK(!solveBFS(level, sol), "solved a board the solver cannot pack");
+}
+
+/* The same (seed, index) gives the same level whatever the thread count */
+static void checkGenerator ()
+{
+	GeneratorParams params = defaultGeneratorParams();
+
+	std::vector<GeneratedLevel> one, four;
+	generatePack(params, 42, 16, 1, one);
+	generatePack(params, 42, 16, 4, four);
+	for (size_t i = 0; i < one.size(); i++) {
+		char name[32];
+		sprintf(name, "generated %d", (int)i);
+		GeneratedLevel again;
+		generateLevel(params, 42, i, again);
+		CHECK(one[i].ok == four[i].ok && one[i].ok == again.ok, "%s: ok differs between runs", name);
+		if (!one[i].ok)
+			continue;
+		CHECK(sameLevel(one[i].level, four[i].level) && sameLevel(one[i].level, again.level), "%s differs between runs", name);
+		CHECK(one[i].sol.moves == again.sol.moves && one[i].attempts == again.attempts, "%s: solution differs between runs", name);
+		CHECK((int)one[i].sol.moves.size() >= params.minMoves, "%s: %d moves", name, (int)one[i].sol.moves.size());
+		checkSolvers(one[i].level, name);
+		checkPacking(one[i].level, name);
+	}
+	// Settings it cannot honour fail at once instead of spinning
+	GeneratedLevel bad;
+	GeneratorParams negative = params, huge = params;
+	negative.minMoves = -5;
+	huge.cols = huge.rows = 200;
+	CHECK(!generateLevel(negative, 42, 0, bad) && bad.attempts == 0, "negative --min-moves accepted");
+	CHECK(!generateLevel(huge, 42, 0, bad) && bad.attempts == 0, "200x200 generator board accepted");
+}
+
+int main ()
+{
+	checkStages();
+	checkSplitShortcut();
+	checkExplore();
+	checkFragile();
+	checkSizeLimit();
+	checkBigBoard();
+	checkBinaryPack();
+	checkGenerator();
+	if (failures) {
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}